@@ -0,0 +1,860 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bimap.h"
+#include "coro_lookup.h"
+#include "flat_bimap.h"
+#include "frozen_bimap.h"
+#include "interning_bimap.h"
+#include "learned_index.h"
+#include "perfect_hash_bimap.h"
+#include "prefix_less.h"
+#include "small_bimap.h"
+#include "static_bimap.h"
+#include "unordered_bimap.h"
+
+namespace {
+
+template <typename F>
+double measure_ns(std::size_t ops, F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(finish - start).count() /
+         static_cast<double>(ops);
+}
+
+// Results of lookups that would otherwise be optimized away
+volatile uint32_t sink;
+
+void report(const char* name, std::size_t size, double ns) {
+  std::printf("%-32s %10zu %10.1f ns/op\n", name, size, ns);
+}
+
+std::vector<uint32_t> random_keys(std::size_t size, uint32_t seed) {
+  std::vector<uint32_t> keys(size);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+  return keys;
+}
+
+// Insert latency on random keys and on sorted keys, which degenerate the
+// unbalanced tree into a chain as deep as the map is large
+void bench_insert() {
+  for (std::size_t size : {10'000, 100'000, 1'000'000}) {
+    auto lefts = random_keys(size, 1);
+    auto rights = random_keys(size, 2);
+    bimap<uint32_t, uint32_t> b;
+    report("insert/random", size, measure_ns(size, [&] {
+             for (std::size_t i = 0; i < size; i++) {
+               b.insert(lefts[i], rights[i]);
+             }
+           }));
+  }
+  for (std::size_t size : {5'000, 20'000}) {
+    bimap<uint32_t, uint32_t> b;
+    report("insert/sorted", size, measure_ns(size, [&] {
+             for (uint32_t i = 0; i < size; i++) {
+               b.insert(i, i);
+             }
+           }));
+  }
+}
+
+using map_t = bimap<uint32_t, uint32_t>;
+using hashed_map_t = bimap<uint32_t, uint32_t, std::less<uint32_t>,
+                           std::less<uint32_t>, std::hash<uint32_t>,
+                           std::hash<uint32_t>>;
+
+// Random map of size pairs over keys 0, stride, ..., (size-1)*stride on both
+// sides
+template <typename Map>
+void fill(Map& b, std::size_t size, uint32_t stride = 1) {
+  auto lefts = random_keys(size, 3);
+  auto rights = random_keys(size, 4);
+  std::vector<std::pair<uint32_t, uint32_t>> pairs(size);
+  for (std::size_t i = 0; i < size; i++) {
+    pairs[i] = {lefts[i] * stride, rights[i] * stride};
+  }
+  b.insert_batch(pairs);
+}
+
+// Single lookups against batched lookups that overlap their cache misses
+void bench_find() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {10'000, 1'000'000, 4'000'000}) {
+    map_t b;
+    fill(b, size);
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(5);
+    for (auto& key : keys) {
+      key = e() % size;
+    }
+    std::vector<map_t::left_iterator> found(probes);
+    std::vector<uint32_t> translated(probes);
+
+    report("find/find_left", size, measure_ns(probes, [&] {
+             for (std::size_t i = 0; i < probes; i++) {
+               found[i] = b.find_left(keys[i]);
+             }
+           }));
+    report("find/find_left_batch", size, measure_ns(probes, [&] {
+             b.find_left_batch(keys, found);
+           }));
+    report("find/translate_left", size, measure_ns(probes, [&] {
+             b.translate_left(keys, translated);
+           }));
+  }
+}
+
+// Sorted dense probes searched from the root against finger search
+void bench_find_sorted() {
+  constexpr std::size_t size = 1'000'000;
+  map_t b;
+  fill(b, size);
+  for (std::size_t probes : {1'000, 100'000, 1'000'000}) {
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(7);
+    for (auto& key : keys) {
+      key = e() % size;
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<map_t::left_iterator> found(probes);
+
+    report("find_sorted/find_left", probes, measure_ns(probes, [&] {
+             for (std::size_t i = 0; i < probes; i++) {
+               found[i] = b.find_left(keys[i]);
+             }
+           }));
+    report("find_sorted/find_left_sorted", probes, measure_ns(probes, [&] {
+             b.find_left_sorted(keys, found);
+           }));
+  }
+}
+
+// Lookups that walk the key space in small random steps, from the root and
+// from the finger of the previous lookup
+void bench_finger() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {10'000, 1'000'000, 4'000'000}) {
+    map_t b;
+    fill(b, size);
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(8);
+    uint32_t key = 0;
+    for (auto& probe : keys) {
+      key = (key + e() % 8) % size;
+      probe = key;
+    }
+    std::vector<map_t::left_iterator> found(probes);
+
+    for (bool cache : {false, true}) {
+      b.enable_finger_cache(cache);
+      report(cache ? "finger/cached" : "finger/find_left", size,
+             measure_ns(probes, [&] {
+               for (std::size_t i = 0; i < probes; i++) {
+                 found[i] = b.find_left(keys[i]);
+               }
+             }));
+    }
+  }
+}
+
+// Zipf-like lookups (log-uniform ranks over random keys) with and without
+// the lookup cache in front of the tree
+void bench_lookup_cache() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {10'000, 1'000'000, 4'000'000}) {
+    map_t b;
+    fill(b, size);
+    auto by_rank = random_keys(size, 9);
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(10);
+    std::uniform_real_distribution<double> exponent(0, 1);
+    for (auto& key : keys) {
+      auto rank = static_cast<std::size_t>(
+          std::pow(static_cast<double>(size), exponent(e)));
+      key = by_rank[std::min(rank, size) - 1];
+    }
+    std::vector<map_t::left_iterator> found(probes);
+
+    for (std::size_t slots : {0, 4'096, 65'536}) {
+      b.enable_lookup_cache(slots);
+      char name[64];
+      std::snprintf(name, sizeof(name), "lookup_cache/slots_%zu", slots);
+      report(name, size, measure_ns(probes, [&] {
+               for (std::size_t i = 0; i < probes; i++) {
+                 found[i] = b.find_left(keys[i]);
+               }
+             }));
+      if (slots) {
+        auto stats = b.left_cache_stats();
+        std::printf("%-32s %10zu %10.1f %%\n", "  hit rate", size,
+                    100.0 * static_cast<double>(stats.hits) /
+                        static_cast<double>(stats.hits + stats.misses));
+      }
+    }
+  }
+}
+
+// find_right where 60% of the probes are absent, with and without the Bloom
+// filter, and insert cost with the filter kept up to date
+void bench_bloom_filter() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {10'000, 1'000'000, 4'000'000}) {
+    map_t b;
+    fill(b, size, 2);
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(11);
+    for (auto& key : keys) {
+      // odd keys are absent
+      key = static_cast<uint32_t>(e() % size * 2 + (e() % 5 < 3));
+    }
+    std::vector<map_t::right_iterator> found(probes);
+
+    for (bool filter : {false, true}) {
+      b.enable_bloom_filter(filter);
+      report(filter ? "bloom_filter/filtered" : "bloom_filter/find_right",
+             size, measure_ns(probes, [&] {
+               for (std::size_t i = 0; i < probes; i++) {
+                 found[i] = b.find_right(keys[i]);
+               }
+             }));
+    }
+  }
+  for (bool filter : {false, true}) {
+    constexpr std::size_t size = 1'000'000;
+    auto lefts = random_keys(size, 1);
+    auto rights = random_keys(size, 2);
+    map_t b;
+    b.enable_bloom_filter(filter);
+    report(filter ? "bloom_filter/insert_filtered" : "bloom_filter/insert",
+           size, measure_ns(size, [&] {
+             for (std::size_t i = 0; i < size; i++) {
+               b.insert(lefts[i], rights[i]);
+             }
+           }));
+  }
+}
+
+// Point lookups through the tree against the hash index of a hybrid map,
+// plus what the index adds to inserts
+void bench_hash_index() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {10'000, 1'000'000, 4'000'000}) {
+    map_t b;
+    fill(b, size);
+    hashed_map_t hashed;
+    fill(hashed, size);
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(12);
+    for (auto& key : keys) {
+      key = e() % size;
+    }
+    std::vector<map_t::left_iterator> found(probes);
+    std::vector<hashed_map_t::left_iterator> hashed_found(probes);
+
+    report("hash_index/find_left", size, measure_ns(probes, [&] {
+             for (std::size_t i = 0; i < probes; i++) {
+               found[i] = b.find_left(keys[i]);
+             }
+           }));
+    report("hash_index/hashed_find_left", size, measure_ns(probes, [&] {
+             for (std::size_t i = 0; i < probes; i++) {
+               hashed_found[i] = hashed.find_left(keys[i]);
+             }
+           }));
+  }
+  constexpr std::size_t size = 1'000'000;
+  auto lefts = random_keys(size, 1);
+  auto rights = random_keys(size, 2);
+  hashed_map_t hashed;
+  report("hash_index/hashed_insert", size, measure_ns(size, [&] {
+           for (std::size_t i = 0; i < size; i++) {
+             hashed.insert(lefts[i], rights[i]);
+           }
+         }));
+}
+
+// unordered_bimap against the pair of std::unordered_maps it replaces
+void bench_unordered() {
+  for (std::size_t size : {10'000, 1'000'000}) {
+    auto lefts = random_keys(size, 1);
+    auto rights = random_keys(size, 2);
+    std::vector<uint32_t> keys(size);
+    std::mt19937 e(13);
+    for (auto& key : keys) {
+      key = e() % size;
+    }
+
+    unordered_bimap<uint32_t, uint32_t> b;
+    report("unordered/bimap_insert", size, measure_ns(size, [&] {
+             for (std::size_t i = 0; i < size; i++) {
+               b.insert(lefts[i], rights[i]);
+             }
+           }));
+    std::unordered_map<uint32_t, uint32_t> by_left, by_right;
+    report("unordered/two_maps_insert", size, measure_ns(size, [&] {
+             for (std::size_t i = 0; i < size; i++) {
+               if (!by_left.count(lefts[i]) && !by_right.count(rights[i])) {
+                 by_left.emplace(lefts[i], rights[i]);
+                 by_right.emplace(rights[i], lefts[i]);
+               }
+             }
+           }));
+
+    uint32_t sum = 0;
+    report("unordered/bimap_at_right", size, measure_ns(size, [&] {
+             for (auto key : keys) {
+               sum += b.at_right(key);
+             }
+           }));
+    report("unordered/two_maps_at", size, measure_ns(size, [&] {
+             for (auto key : keys) {
+               sum += by_right.at(key);
+             }
+           }));
+    sink = sum;
+  }
+}
+
+using vec = std::pair<int, int>;
+
+// Orders vectors by euclidean length, computing sqrt for both operands
+struct length_less {
+  bool operator()(vec a, vec b) const {
+    return length(a) < length(b);
+  }
+
+  static double length(vec a) {
+    return std::sqrt(double(a.first) * a.first + double(a.second) * a.second);
+  }
+};
+
+// Same order, with the length cached in the nodes as a projection
+struct projected_length_less : length_less {
+  double project(vec a) const {
+    return length(a);
+  }
+};
+
+template <typename Compare>
+void bench_projection_with(const char* name, std::size_t size) {
+  std::mt19937 e(14);
+  std::vector<vec> keys(size);
+  for (auto& key : keys) {
+    key = {int(e() % 1'000'000), int(e() % 1'000'000)};
+  }
+  auto rights = random_keys(size, 15);
+  bimap<vec, uint32_t, Compare> b;
+  for (std::size_t i = 0; i < size; i++) {
+    b.insert(keys[i], rights[i]);
+  }
+  std::shuffle(keys.begin(), keys.end(), e);
+  uint32_t sum = 0;
+  report(name, size, measure_ns(size, [&] {
+           for (auto& key : keys) {
+             sum += b.find_left(key) != b.end_left();
+           }
+         }));
+  sink = sum;
+}
+
+// Lookups with an expensive comparator, with and without cached projections
+void bench_projection() {
+  for (std::size_t size : {10'000, 1'000'000}) {
+    bench_projection_with<length_less>("projection/sqrt_compare", size);
+    bench_projection_with<projected_length_less>("projection/projected", size);
+  }
+}
+
+template <typename Compare>
+void bench_string_prefix_with(const char* name, std::size_t size) {
+  // URL-like keys: the scheme fills the first 8 bytes of every key, the host
+  // differs in the next ones
+  std::mt19937 e(16);
+  std::vector<std::string> keys(size);
+  for (auto& key : keys) {
+    key = "https://";
+    for (int i = 0; i < 10; i++) {
+      key += char('a' + e() % 26);
+    }
+    key += ".example.com/item/" + std::to_string(e());
+  }
+  auto rights = random_keys(size, 17);
+  bimap<std::string, uint32_t, Compare> b;
+  for (std::size_t i = 0; i < size; i++) {
+    b.insert(keys[i], rights[i]);
+  }
+  std::shuffle(keys.begin(), keys.end(), e);
+  uint32_t sum = 0;
+  report(name, size, measure_ns(size, [&] {
+           for (auto& key : keys) {
+             sum += b.find_left(key) != b.end_left();
+           }
+         }));
+  sink = sum;
+}
+
+// String lookups that dereference every key on the way down against ones
+// comparing prefixes cached in the nodes
+void bench_string_prefix() {
+  for (std::size_t size : {10'000, 1'000'000}) {
+    bench_string_prefix_with<std::less<std::string>>("string_prefix/less",
+                                                     size);
+    bench_string_prefix_with<prefix_less<8>>("string_prefix/prefix_8", size);
+    bench_string_prefix_with<prefix_less<16>>("string_prefix/prefix_16",
+                                              size);
+  }
+}
+
+template <typename Key>
+void bench_inline_string_with(const char* name, std::size_t size) {
+  // dictionary-like keys too long for the small string buffer
+  std::mt19937 e(18);
+  std::vector<std::string> lefts(size), rights(size);
+  for (std::size_t i = 0; i < size; i++) {
+    lefts[i] = "word/" + std::to_string(e()) + "/" + std::to_string(i);
+    rights[i] = "translation/" + std::to_string(e()) + "/" + std::to_string(i);
+  }
+  char label[64];
+  bimap<Key, Key> b;
+  std::snprintf(label, sizeof(label), "%s_insert", name);
+  report(label, size, measure_ns(size, [&] {
+           for (std::size_t i = 0; i < size; i++) {
+             b.insert(lefts[i], rights[i]);
+           }
+         }));
+  std::shuffle(rights.begin(), rights.end(), e);
+  uint32_t sum = 0;
+  std::snprintf(label, sizeof(label), "%s_find", name);
+  report(label, size, measure_ns(size, [&] {
+           for (auto& key : rights) {
+             sum += b.find_right(key) != b.end_right();
+           }
+         }));
+  sink = sum;
+}
+
+// String pairs as std::string, a node plus two string buffers, against
+// inline_string, one allocation holding the node and the characters
+void bench_inline_string() {
+  for (std::size_t size : {10'000, 1'000'000}) {
+    bench_inline_string_with<std::string>("inline_string/std_string", size);
+    bench_inline_string_with<inline_string>("inline_string/inline", size);
+  }
+}
+
+// Dictionary encoding of a column with repeated words and decoding it back,
+// with ids kept by hand in a bimap and assigned by interning_bimap. The bimap
+// ids are scrambled, as sequential ones would make its right tree a chain
+void bench_interning() {
+  for (std::size_t size : {10'000, 1'000'000}) {
+    std::mt19937 e(19);
+    std::vector<std::string> column(size * 4);
+    for (auto& word : column) {
+      word = "word/" + std::to_string(e() % size);
+    }
+    std::vector<uint32_t> codes(column.size());
+    std::size_t decoded = 0;
+    auto scramble = [](std::size_t id) {
+      return static_cast<uint32_t>(id * 0x9E3779B1u);
+    };
+
+    bimap<std::string, uint32_t> b;
+    report("interning/bimap_encode", size, measure_ns(column.size(), [&] {
+             for (std::size_t i = 0; i < column.size(); i++) {
+               auto it = b.find_left(column[i]);
+               codes[i] = it != b.end_left()
+                              ? *it.flip()
+                              : *b.insert(column[i], scramble(b.size()))
+                                     .flip();
+             }
+           }));
+    report("interning/bimap_decode", size, measure_ns(column.size(), [&] {
+             for (uint32_t code : codes) {
+               decoded += b.at_right(code).size();
+             }
+           }));
+
+    interning_bimap<std::string> interned;
+    report("interning/intern_encode", size, measure_ns(column.size(), [&] {
+             for (std::size_t i = 0; i < column.size(); i++) {
+               codes[i] = interned.intern(column[i]);
+             }
+           }));
+    report("interning/intern_decode", size, measure_ns(column.size(), [&] {
+             for (uint32_t code : codes) {
+               decoded += interned.at_right(code).size();
+             }
+           }));
+    sink = static_cast<uint32_t>(decoded);
+  }
+}
+
+template <typename Map>
+void bench_small_with(const char* name, std::size_t pairs) {
+  constexpr std::size_t maps = 100'000;
+  std::mt19937 e(20);
+  std::vector<uint32_t> keys(pairs * 2);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::vector<Map> all(maps);
+  char label[64];
+  std::snprintf(label, sizeof(label), "%s_build", name);
+  report(label, pairs, measure_ns(maps * pairs, [&] {
+           for (auto& b : all) {
+             std::shuffle(keys.begin(), keys.end(), e);
+             for (std::size_t i = 0; i < pairs; i++) {
+               b.insert(keys[i], keys[pairs + i]);
+             }
+           }
+         }));
+  uint32_t sum = 0;
+  std::snprintf(label, sizeof(label), "%s_find", name);
+  report(label, pairs, measure_ns(maps * pairs, [&] {
+           for (std::size_t i = 0; i < maps * pairs; i++) {
+             auto& b = all[e() % maps];
+             sum += b.find_left(e() % (pairs * 2)) != b.end_left();
+           }
+         }));
+  sink = sum;
+}
+
+// Many tiny maps, as per-connection tables, as trees and inline
+void bench_small() {
+  for (std::size_t pairs : {4, 8, 16}) {
+    bench_small_with<map_t>("small/bimap", pairs);
+    bench_small_with<small_bimap<uint32_t, uint32_t>>("small/inline", pairs);
+  }
+}
+
+template <typename Map>
+void bench_static_with(const char* name, Map& b, std::size_t size) {
+  constexpr std::size_t ops = 1'000'000;
+  std::mt19937 e(21);
+  auto keys = random_keys(size * 2, 22);
+  for (std::size_t i = 0; i < size; i++) {
+    b.insert(keys[i], keys[i]);
+  }
+  // replaces a random pair with an absent key each step, like an order book
+  report(name, size, measure_ns(ops, [&] {
+           for (std::size_t i = 0; i < ops; i++) {
+             std::size_t out = e() % size;
+             std::size_t in = size + e() % size;
+             b.erase_left(keys[out]);
+             b.insert(keys[in], keys[in]);
+             std::swap(keys[out], keys[in]);
+           }
+         }));
+}
+
+// Insert and erase churn with nodes from the allocator and from the array
+// inside static_bimap
+void bench_static() {
+  constexpr std::size_t size = 1'000;
+  map_t b;
+  bench_static_with("static/bimap", b, size);
+  auto fixed = std::make_unique<static_bimap<uint32_t, uint32_t, size>>();
+  bench_static_with("static/static_bimap", *fixed, size);
+}
+
+template <typename Map>
+void bench_flat_with(const char* name, std::size_t size) {
+  constexpr std::size_t probes = 1'000'000;
+  Map b;
+  char label[64];
+  std::snprintf(label, sizeof(label), "%s_build", name);
+  report(label, size, measure_ns(size, [&] { fill(b, size); }));
+  std::vector<uint32_t> keys(probes);
+  std::mt19937 e(23);
+  for (auto& key : keys) {
+    key = e() % size;
+  }
+  uint32_t sum = 0;
+  std::snprintf(label, sizeof(label), "%s_find", name);
+  report(label, size, measure_ns(probes, [&] {
+           for (uint32_t key : keys) {
+             sum += *b.find_left(key).flip();
+           }
+         }));
+  std::snprintf(label, sizeof(label), "%s_find_right", name);
+  report(label, size, measure_ns(probes, [&] {
+           for (uint32_t key : keys) {
+             sum += *b.find_right(key).flip();
+           }
+         }));
+  sink = sum;
+}
+
+// Build once and read a lot, with nodes against sorted arrays
+void bench_flat() {
+  for (std::size_t size : {10'000, 1'000'000, 4'000'000}) {
+    bench_flat_with<map_t>("flat/bimap", size);
+    bench_flat_with<flat_bimap<uint32_t, uint32_t>>("flat/flat", size);
+  }
+}
+
+// Publishing a snapshot of a routing table and reading it, against
+// reading the tree itself
+void bench_frozen() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {10'000, 1'000'000}) {
+    map_t b;
+    fill(b, size);
+    frozen_bimap<uint32_t, uint32_t> frozen;
+    report("frozen/freeze", size, measure_ns(size, [&] {
+             frozen = b.freeze();
+           }));
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(24);
+    for (auto& key : keys) {
+      key = e() % size;
+    }
+    uint32_t sum = 0;
+    report("frozen/bimap_find", size, measure_ns(probes, [&] {
+             for (uint32_t key : keys) {
+               sum += *b.find_left(key).flip();
+             }
+           }));
+    report("frozen/frozen_find", size, measure_ns(probes, [&] {
+             for (uint32_t key : keys) {
+               sum += *frozen.find_left(key).flip();
+             }
+           }));
+    sink = sum;
+  }
+}
+
+template <typename Key>
+void bench_eytzinger_with(const char* name, std::size_t size) {
+  constexpr std::size_t probes = 1'000'000;
+  // odd multipliers keep distinct keys distinct and spread them over the type
+  auto spread = [](uint32_t key) {
+    return static_cast<Key>(key * static_cast<Key>(0x9E3779B97F4A7C15u));
+  };
+  auto lefts = random_keys(size, 25);
+  auto rights = random_keys(size, 26);
+  std::vector<std::pair<Key, Key>> pairs(size);
+  for (std::size_t i = 0; i < size; i++) {
+    pairs[i] = {spread(lefts[i]), spread(rights[i])};
+  }
+  flat_bimap<Key, Key> flat;
+  flat.insert_batch(pairs);
+  frozen_bimap<Key, Key> frozen(flat.begin_left(), flat.end_left());
+  std::vector<Key> keys(probes);
+  std::mt19937 e(27);
+  for (auto& key : keys) {
+    key = spread(lefts[e() % size]);
+  }
+  Key sum = 0;
+  char label[64];
+  std::snprintf(label, sizeof(label), "eytzinger/%s_binary", name);
+  report(label, size, measure_ns(probes, [&] {
+           for (Key key : keys) {
+             sum += flat.find_left(key) != flat.end_left();
+           }
+         }));
+  std::snprintf(label, sizeof(label), "eytzinger/%s_eytzinger", name);
+  report(label, size, measure_ns(probes, [&] {
+           for (Key key : keys) {
+             sum += frozen.find_left(key) != frozen.end_left();
+           }
+         }));
+  sink = static_cast<uint32_t>(sum);
+}
+
+// Binary search over the sorted arrays against the Eytzinger index with
+// vector compares over the last block
+void bench_eytzinger() {
+  for (std::size_t size : {10'000, 1'000'000, 4'000'000}) {
+    bench_eytzinger_with<uint32_t>("u32", size);
+    bench_eytzinger_with<uint64_t>("u64", size);
+  }
+}
+
+template <typename Map>
+void bench_learned_find(const char* name, const char* keys_name,
+                        const Map& b, const std::vector<uint64_t>& probes) {
+  uint32_t sum = 0;
+  char label[64];
+  std::snprintf(label, sizeof(label), "learned/%s_%s", keys_name, name);
+  report(label, b.size(), measure_ns(probes.size(), [&] {
+           for (uint64_t key : probes) {
+             sum += b.find_left(key) != b.end_left();
+           }
+         }));
+  sink = sum;
+}
+
+// Tree descent, binary search and the two indexes over smooth keys, as
+// timestamps, and over random ones, which the model fits badly
+void bench_learned() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {1'000'000, 4'000'000}) {
+    for (bool smooth : {true, false}) {
+      std::mt19937_64 e(28);
+      auto rights = random_keys(size, 29);
+      std::vector<std::pair<uint64_t, uint64_t>> pairs(size);
+      uint64_t time = 1'700'000'000'000'000;
+      for (std::size_t i = 0; i < size; i++) {
+        time += smooth ? 1000 + e() % 200 : 0;
+        pairs[i] = {smooth ? time : e(), rights[i]};
+      }
+      bimap<uint64_t, uint64_t> b;
+      b.insert_batch(pairs);
+      flat_bimap<uint64_t, uint64_t> flat;
+      flat.insert_batch(pairs);
+      auto eytzinger = b.freeze();
+      auto learned = b.freeze<learned_index>();
+      std::vector<uint64_t> keys(probes);
+      for (auto& key : keys) {
+        key = pairs[e() % size].first;
+      }
+      const char* keys_name = smooth ? "smooth" : "random";
+      bench_learned_find("tree", keys_name, b, keys);
+      bench_learned_find("binary", keys_name, flat, keys);
+      bench_learned_find("eytzinger", keys_name, eytzinger, keys);
+      bench_learned_find("learned", keys_name, learned, keys);
+      learned_index<uint64_t> model(flat.begin_left(), flat.end_left());
+      std::printf("%-32s %10zu %10zu bytes\n", "learned/model", size,
+                  model.model_bytes());
+    }
+  }
+}
+
+template <typename Map>
+void bench_perfect_find(const char* name, const Map& b,
+                        const std::vector<std::string>& names,
+                        const std::vector<uint32_t>& tags) {
+  constexpr std::size_t probes = 1'000'000;
+  std::mt19937 e(31);
+  std::vector<std::size_t> picks(probes);
+  for (auto& pick : picks) {
+    pick = e() % names.size();
+  }
+  std::size_t sum = 0;
+  char label[64];
+  std::snprintf(label, sizeof(label), "perfect/%s_name", name);
+  report(label, names.size(), measure_ns(probes, [&] {
+           for (std::size_t pick : picks) {
+             sum += *b.find_left(names[pick]).flip();
+           }
+         }));
+  std::snprintf(label, sizeof(label), "perfect/%s_tag", name);
+  report(label, names.size(), measure_ns(probes, [&] {
+           for (std::size_t pick : picks) {
+             sum += b.find_right(tags[pick]).flip()->size();
+           }
+         }));
+  sink = static_cast<uint32_t>(sum);
+}
+
+// Field name to tag tables that are built once, in hash tables with a node
+// per pair and with a perfect hash per side
+void bench_perfect() {
+  for (std::size_t size : {1'000, 100'000, 1'000'000}) {
+    auto tags = random_keys(size, 30);
+    std::vector<std::string> names(size);
+    std::vector<std::pair<std::string, uint32_t>> pairs(size);
+    for (std::size_t i = 0; i < size; i++) {
+      names[i] = "protocol.field." + std::to_string(i);
+      pairs[i] = {names[i], tags[i]};
+    }
+    unordered_bimap<std::string, uint32_t> hashed;
+    report("perfect/unordered_build", size, measure_ns(size, [&] {
+             for (auto& [name, tag] : pairs) {
+               hashed.insert(name, tag);
+             }
+           }));
+    std::unique_ptr<perfect_hash_bimap<std::string, uint32_t>> perfect;
+    report("perfect/perfect_build", size, measure_ns(size, [&] {
+             perfect = std::make_unique<
+                 perfect_hash_bimap<std::string, uint32_t>>(pairs);
+           }));
+    bench_perfect_find("unordered", hashed, names, tags);
+    bench_perfect_find("perfect", *perfect, names, tags);
+  }
+}
+
+coro::task<> lookup(const map_t& b, uint32_t key, map_t::left_iterator& out) {
+  out = co_await coro::async_find(b.find_left_stepwise(key));
+}
+
+// Plain find_left against coroutine lookups interleaved by a scheduler, from
+// maps that fit in L2 to maps far beyond the last level cache
+void bench_async_find() {
+  constexpr std::size_t probes = 1'000'000;
+  for (std::size_t size : {10'000, 100'000, 1'000'000, 4'000'000}) {
+    map_t b;
+    fill(b, size);
+    std::vector<uint32_t> keys(probes);
+    std::mt19937 e(6);
+    for (auto& key : keys) {
+      key = e() % size;
+    }
+    std::vector<map_t::left_iterator> found(probes);
+
+    report("async_find/find_left", size, measure_ns(probes, [&] {
+             for (std::size_t i = 0; i < probes; i++) {
+               found[i] = b.find_left(keys[i]);
+             }
+           }));
+    for (std::size_t width : {8, 16, 32}) {
+      char name[64];
+      std::snprintf(name, sizeof(name), "async_find/coro_width_%zu", width);
+      report(name, size, measure_ns(probes, [&] {
+               coro::scheduler scheduler(width);
+               for (std::size_t i = 0; i < probes; i++) {
+                 scheduler.spawn(lookup(b, keys[i], found[i]));
+               }
+               scheduler.run();
+             }));
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const char* filter = argc > 1 ? argv[1] : "";
+  struct {
+    const char* name;
+    void (*run)();
+  } benches[] = {
+      {"insert", bench_insert},
+      {"find", bench_find},
+      {"find_sorted", bench_find_sorted},
+      {"finger", bench_finger},
+      {"lookup_cache", bench_lookup_cache},
+      {"bloom_filter", bench_bloom_filter},
+      {"hash_index", bench_hash_index},
+      {"unordered", bench_unordered},
+      {"projection", bench_projection},
+      {"string_prefix", bench_string_prefix},
+      {"inline_string", bench_inline_string},
+      {"interning", bench_interning},
+      {"small", bench_small},
+      {"static", bench_static},
+      {"flat", bench_flat},
+      {"frozen", bench_frozen},
+      {"eytzinger", bench_eytzinger},
+      {"learned", bench_learned},
+      {"perfect", bench_perfect},
+      {"async_find", bench_async_find},
+  };
+  for (auto& bench : benches) {
+    if (std::strstr(bench.name, filter)) {
+      bench.run();
+    }
+  }
+}
@@ -1,11 +1,31 @@
 #pragma once
 
+#include "frozen_bimap.h"
+#include "inline_string.h"
+#include "intrusive_hash_set.h"
 #include "intrusive_set.h"
+#include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <numeric>
+#include <stdexcept>
+#include <span>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
+// A non-void HashLeft or HashRight adds a hash index over the nodes of that
+// side: find, at and erase by key become O(1) expected while ordered
+// operations keep using the tree. The hash must agree with the comparator:
+// equivalent keys have equal hashes
 template <typename Left, typename Right, typename CompareLeft = std::less<Left>,
-          typename CompareRight = std::less<Right>>
+          typename CompareRight = std::less<Right>, typename HashLeft = void,
+          typename HashRight = void>
 struct bimap {
 private:
   using left_t = Left;
@@ -20,17 +40,47 @@ private:
 
   struct right_struct;
 
+  // Stand-ins for the hash index and its node links on sides without a hash
+  template <typename Tag>
+  struct no_hash_node {};
+
+  struct no_hash_set {};
+
+  template <typename Hash, typename Tag, typename Key, typename Getter>
+  using hash_set_for =
+      std::conditional_t<std::is_void_v<Hash>, no_hash_set,
+                         intrusive::intrusive_hash_set<storage_node, Key, Tag,
+                                                       Hash, Getter>>;
+
+  template <typename Hash, typename Tag>
+  using hash_node_for = std::conditional_t<std::is_void_v<Hash>,
+                                           no_hash_node<Tag>,
+                                           intrusive::hash_node<Tag>>;
+
   struct left_struct {
   public:
     struct getter {
       static const left_t& get(const storage_node& storage_node) noexcept {
         return storage_node.left_key;
       }
+
+      static const auto& projection(const storage_node& storage_node) noexcept
+        requires intrusive::details::projecting<CompareLeft, left_t>
+      {
+        return storage_node.left_projection;
+      }
     };
     using key = left_t;
+    using compare = CompareLeft;
+    using projection =
+        typename intrusive::details::projection_of<CompareLeft, key,
+                                                   tag_for_left>::type;
     using base_node = intrusive::node<tag_for_left>;
     using set = intrusive::intrusive_set<storage_node, key, tag_for_left,
                                          CompareLeft, getter>;
+    static constexpr bool hashed = !std::is_void_v<HashLeft>;
+    using hash_node = hash_node_for<HashLeft, tag_for_left>;
+    using hash_set = hash_set_for<HashLeft, tag_for_left, key, getter>;
     using iterator = template_iterator<left_struct>;
     using flip_struct = right_struct;
   };
@@ -41,25 +91,47 @@ private:
       static const right_t& get(const storage_node& storage_node) noexcept {
         return storage_node.right_key;
       }
+
+      static const auto& projection(const storage_node& storage_node) noexcept
+        requires intrusive::details::projecting<CompareRight, right_t>
+      {
+        return storage_node.right_projection;
+      }
     };
     using key = right_t;
+    using compare = CompareRight;
+    using projection =
+        typename intrusive::details::projection_of<CompareRight, key,
+                                                   tag_for_right>::type;
     using base_node = intrusive::node<tag_for_right>;
     using set = intrusive::intrusive_set<storage_node, key, tag_for_right,
                                          CompareRight, getter>;
+    static constexpr bool hashed = !std::is_void_v<HashRight>;
+    using hash_node = hash_node_for<HashRight, tag_for_right>;
+    using hash_set = hash_set_for<HashRight, tag_for_right, key, getter>;
     using iterator = template_iterator<right_struct>;
     using flip_struct = left_struct;
   };
 
-  struct bimap_based_node : left_struct::base_node, right_struct::base_node {};
+  struct bimap_based_node : left_struct::base_node, right_struct::base_node,
+                            left_struct::hash_node, right_struct::hash_node {};
 
   struct storage_node : bimap_based_node {
   public:
     typename left_struct::key left_key;
     typename right_struct::key right_key;
+    // Projections of the keys for comparators that have them
+    [[no_unique_address]] typename left_struct::projection left_projection;
+    [[no_unique_address]] typename right_struct::projection right_projection;
 
     template <typename L, typename R>
-    storage_node(L&& l, R&& r)
-        : left_key(std::forward<L>(l)), right_key(std::forward<R>(r)) {}
+    storage_node(L&& l, R&& r, const CompareLeft& compare_left,
+                 const CompareRight& compare_right)
+        : left_key(std::forward<L>(l)), right_key(std::forward<R>(r)),
+          left_projection(intrusive::details::project<tag_for_left>(
+              compare_left, left_key)),
+          right_projection(intrusive::details::project<tag_for_right>(
+              compare_right, right_key)) {}
   };
 
   template <class Traits>
@@ -148,11 +220,27 @@ public:
     left_set.swap(other.left_set);
     right_set.swap(other.right_set);
     std::swap(m_size, other.m_size);
+    extras.swap(other.extras);
+    if constexpr (left_struct::hashed) {
+      left_hash.swap(other.left_hash);
+    }
+    if constexpr (right_struct::hashed) {
+      right_hash.swap(other.right_hash);
+    }
   }
 
   bimap(const bimap& other)
       : left_set(sentinel, static_cast<CompareLeft>(other.left_set)),
         right_set(sentinel, static_cast<CompareRight>(other.right_set)) {
+    if (other.extras) {
+      // the settings carry over, the cached state is rebuilt by the inserts
+      extras = std::make_unique<accelerators>();
+      extras->finger_cache = other.extras->finger_cache;
+      extras->left_cache = front_cache(other.extras->left_cache.slots.size());
+      extras->right_cache =
+          front_cache(other.extras->right_cache.slots.size());
+      extras->bloom_filter = other.extras->bloom_filter;
+    }
     for (auto it = other.begin_left(); it != other.end_left(); it++) {
       insert(*it, *it.flip());
     }
@@ -172,14 +260,661 @@ public:
 private:
   template <typename L, typename R>
   left_iterator perfect_forwarding_insert(L&& left, R&& right) {
-    if (!(find_left(left) == end_left() && find_right(right) == end_right())) {
+    auto left_pos = left_set.find_insert_position(left);
+    if (left_pos.exists) {
+      return end_left();
+    }
+    auto right_pos = right_set.find_insert_position(right);
+    if (right_pos.exists) {
       return end_left();
     }
-    auto* storage =
-        new storage_node(std::forward<L>(left), std::forward<R>(right));
-    right_set.insert(*storage, true);
+    reserve_indexes(m_size + 1);
+    auto* storage = make_node(std::forward<L>(left), std::forward<R>(right));
+    index_node(*storage);
+    right_set.insert(*storage, right_pos);
     m_size++;
-    return left_iterator(left_set.insert(*storage, true));
+    return left_iterator(left_set.insert(*storage, left_pos));
+  }
+
+  static constexpr bool inline_keys =
+      std::is_same_v<left_t, inline_string> ||
+      std::is_same_v<right_t, inline_string>;
+
+  // Characters of an inline_string key go to bytes, which then points past
+  // them, and the key becomes a view of the copy. Other keys pass through
+  template <typename Key, typename K>
+  static decltype(auto) place_key(char*& bytes, K&& key) noexcept {
+    if constexpr (std::is_same_v<Key, inline_string>) {
+      std::string_view view = key;
+      if (!view.empty()) {
+        std::memcpy(bytes, view.data(), view.size());
+      }
+      inline_string placed(bytes, view.size());
+      bytes += view.size();
+      return placed;
+    } else {
+      return std::forward<K>(key);
+    }
+  }
+
+  template <typename Key, typename K>
+  static std::size_t inline_size(const K& key) noexcept {
+    if constexpr (std::is_same_v<Key, inline_string>) {
+      return std::string_view(key).size();
+    } else {
+      return 0;
+    }
+  }
+
+  // Nodes with inline_string keys are one allocation holding the node and
+  // then the characters of its keys
+  template <typename L, typename R>
+  storage_node* make_node(L&& left, R&& right) const {
+    if constexpr (!inline_keys) {
+      return new storage_node(std::forward<L>(left), std::forward<R>(right),
+                              left_set, right_set);
+    } else {
+      void* memory = ::operator new(sizeof(storage_node) +
+                                    inline_size<left_t>(left) +
+                                    inline_size<right_t>(right));
+      char* bytes = static_cast<char*>(memory) + sizeof(storage_node);
+      try {
+        return ::new (memory) storage_node(
+            place_key<left_t>(bytes, std::forward<L>(left)),
+            place_key<right_t>(bytes, std::forward<R>(right)), left_set,
+            right_set);
+      } catch (...) {
+        ::operator delete(memory);
+        throw;
+      }
+    }
+  }
+
+  static void destroy_node(storage_node* node) noexcept {
+    if constexpr (!inline_keys) {
+      delete node;
+    } else if (node) {
+      node->~storage_node();
+      ::operator delete(node);
+    }
+  }
+
+  // Heterogeneous overloads need an is_transparent comparator that accepts K,
+  // otherwise K converts to the key. Iterators always go to the iterator
+  // overloads of erase
+  template <typename K, typename Traits>
+  static constexpr bool transparent_key =
+      intrusive::details::transparent<typename Traits::compare> &&
+      std::is_invocable_v<const typename Traits::compare&,
+                          const typename Traits::key&, const K&> &&
+      !std::is_convertible_v<const K&, typename Traits::iterator>;
+
+  template <typename Traits>
+  typename Traits::set& set_of() noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return left_set;
+    } else {
+      return right_set;
+    }
+  }
+
+  template <typename Traits>
+  const typename Traits::set& set_of() const noexcept {
+    return const_cast<bimap*>(this)->set_of<Traits>();
+  }
+
+  template <typename Traits>
+  typename Traits::set::iterator& finger_of() const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return extras->left_finger;
+    } else {
+      return extras->right_finger;
+    }
+  }
+
+  template <typename K>
+  static constexpr bool hashable = requires(const K& key) {
+    { std::hash<K>{}(key) } -> std::convertible_to<std::size_t>;
+  };
+
+  // Keys equivalent under the standard orders are equal, so std::hash agrees
+  // with them. The caches and filters serve only such sides, since equivalent
+  // keys with different hashes would miss their entries
+  template <typename K, typename Compare>
+  static constexpr bool hash_consistent =
+      hashable<K> &&
+      (std::is_same_v<Compare, std::less<K>> ||
+       std::is_same_v<Compare, std::less<>> ||
+       std::is_same_v<Compare, std::greater<K>> ||
+       std::is_same_v<Compare, std::greater<>>);
+
+  static constexpr bool left_hashable = hash_consistent<left_t, CompareLeft>;
+  static constexpr bool right_hashable =
+      hash_consistent<right_t, CompareRight>;
+
+  // Direct-mapped table from hashed keys to the nodes last found by them.
+  // Slots are empty while the lookup cache is off
+  struct front_cache {
+    std::vector<storage_node*> slots;
+    int shift;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+
+    explicit front_cache(std::size_t size = 0)
+        : slots(size), shift(64 - std::countr_zero(std::uint64_t{size})) {}
+  };
+
+  // Hands out the iterators of the map instead of those of the tree
+  template <typename Traits>
+  struct stepwise_find
+      : Traits::set::template stepwise_find<typename Traits::key> {
+    typename Traits::iterator result() const noexcept {
+      return typename Traits::iterator(
+          Traits::set::template stepwise_find<typename Traits::key>::result());
+    }
+  };
+
+  template <typename Traits>
+  front_cache& cache_of() const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return extras->left_cache;
+    } else {
+      return extras->right_cache;
+    }
+  }
+
+  template <typename Traits, typename K>
+  bool equivalent(const K& key,
+                  const typename Traits::key& other) const noexcept {
+    const auto& compare =
+        static_cast<const typename Traits::compare&>(set_of<Traits>());
+    return !intrusive::details::compare_less(compare, key, other) &&
+           !intrusive::details::compare_less(compare, other, key);
+  }
+
+  // Cache slot of key, or null when the side has no cache or key is a
+  // transparent key, whose hash may differ from the hash of the stored key
+  template <typename Traits, typename K>
+  storage_node** cache_slot(const K& key) const noexcept {
+    if constexpr (std::is_same_v<K, typename Traits::key> &&
+                  hash_consistent<K, typename Traits::compare>) {
+      if (!extras) {
+        return nullptr;
+      }
+      auto& cache = cache_of<Traits>();
+      if (!cache.slots.empty()) {
+        std::uint64_t hash = std::hash<K>{}(key);
+        return &cache.slots[(hash * 0x9E3779B97F4A7C15ull) >> cache.shift];
+      }
+    }
+    return nullptr;
+  }
+
+  // Blocked counting Bloom filter over key hashes. The three counters of a
+  // key share a 64-byte block, so a query reads one cache line, and erasing a
+  // key decrements them. Counters stick at 255 instead of wrapping around.
+  // Holds no blocks while the filter is off
+  struct key_filter {
+    static constexpr std::size_t keys_per_block = 8;
+
+    struct alignas(64) block {
+      std::uint8_t counters[64];
+    };
+
+    std::vector<block> blocks;
+
+    bool may_contain(std::uint64_t hash) const noexcept {
+      hash = mix(hash);
+      const auto& counters = blocks[hash & (blocks.size() - 1)].counters;
+      return counters[hash >> 58] && counters[(hash >> 52) & 63] &&
+             counters[(hash >> 46) & 63];
+    }
+
+    void update(std::uint64_t hash, int delta) noexcept {
+      hash = mix(hash);
+      auto& counters = blocks[hash & (blocks.size() - 1)].counters;
+      for (auto i : {hash >> 58, (hash >> 52) & 63, (hash >> 46) & 63}) {
+        if (counters[i] != 255) {
+          counters[i] = static_cast<std::uint8_t>(counters[i] + delta);
+        }
+      }
+    }
+
+    // std::hash is the identity for integers, so its bits are mixed first
+    static std::uint64_t mix(std::uint64_t hash) noexcept {
+      hash ^= hash >> 33;
+      hash *= 0xff51afd7ed558ccdull;
+      hash ^= hash >> 33;
+      hash *= 0xc4ceb9fe1a85ec53ull;
+      return hash ^ (hash >> 33);
+    }
+  };
+
+  template <typename Traits>
+  key_filter& filter_of() noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return extras->left_filter;
+    } else {
+      return extras->right_filter;
+    }
+  }
+
+  template <typename Traits>
+  const key_filter& filter_of() const noexcept {
+    return const_cast<bimap*>(this)->filter_of<Traits>();
+  }
+
+  // State of the opt-in accelerators. The first enable_ call allocates it,
+  // so plain maps neither store it nor maintain it on insert and erase
+  struct accelerators {
+    bool finger_cache = false;
+    typename left_struct::set::iterator left_finger;
+    typename right_struct::set::iterator right_finger;
+    front_cache left_cache;
+    front_cache right_cache;
+    bool bloom_filter = false;
+    key_filter left_filter;
+    key_filter right_filter;
+  };
+
+  accelerators& accelerate() {
+    if (!extras) {
+      extras = std::make_unique<accelerators>();
+    }
+    return *extras;
+  }
+
+  // False only if no key of the side is equivalent to key. Always true for
+  // transparent keys and sides without a filter
+  template <typename Traits, typename K>
+  bool may_contain(const K& key) const noexcept {
+    if constexpr (std::is_same_v<K, typename Traits::key> &&
+                  hash_consistent<K, typename Traits::compare>) {
+      if (!extras) {
+        return true;
+      }
+      const auto& filter = filter_of<Traits>();
+      return filter.blocks.empty() ||
+             filter.may_contain(std::hash<K>{}(key));
+    }
+    return true;
+  }
+
+  // Adds (delta = 1) or removes (delta = -1) the keys of node
+  void filter_update(const storage_node& node, int delta) noexcept {
+    if (!extras) {
+      return;
+    }
+    if constexpr (left_hashable) {
+      if (!extras->left_filter.blocks.empty()) {
+        extras->left_filter.update(std::hash<left_t>{}(node.left_key), delta);
+      }
+    }
+    if constexpr (right_hashable) {
+      if (!extras->right_filter.blocks.empty()) {
+        extras->right_filter.update(std::hash<right_t>{}(node.right_key),
+                                    delta);
+      }
+    }
+  }
+
+  // Grows the filters to keep about keys_per_block keys per block once the
+  // map holds size pairs, refilling them from the tree. Doubling keeps this
+  // amortized O(1) per insert
+  void reserve_filters(std::size_t size) {
+    if (!extras || !extras->bloom_filter) {
+      return;
+    }
+    std::size_t blocks = std::bit_ceil(
+        std::max<std::size_t>(1, size / key_filter::keys_per_block));
+    if (std::max(extras->left_filter.blocks.size(),
+                 extras->right_filter.blocks.size()) >= blocks) {
+      return;
+    }
+    if constexpr (left_hashable) {
+      extras->left_filter.blocks.resize(blocks);
+    }
+    if constexpr (right_hashable) {
+      extras->right_filter.blocks.resize(blocks);
+    }
+    refill_filters();
+  }
+
+  void refill_filters() noexcept {
+    if (!extras) {
+      return;
+    }
+    for (auto* filter : {&extras->left_filter, &extras->right_filter}) {
+      std::fill(filter->blocks.begin(), filter->blocks.end(),
+                typename key_filter::block{});
+    }
+    for (auto it = begin_left(); it != end_left(); ++it) {
+      filter_update(static_cast<const storage_node&>(*it.it), 1);
+    }
+  }
+
+  template <typename Traits>
+  typename Traits::hash_set& hash_of() noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return left_hash;
+    } else {
+      return right_hash;
+    }
+  }
+
+  template <typename Traits>
+  const typename Traits::hash_set& hash_of() const noexcept {
+    return const_cast<bimap*>(this)->hash_of<Traits>();
+  }
+
+  // Hash indexes and filters follow every node linked into or unlinked from
+  // the trees. Reserving first keeps index_node from allocating
+  void reserve_indexes(std::size_t size) {
+    if constexpr (left_struct::hashed) {
+      left_hash.reserve(size);
+    }
+    if constexpr (right_struct::hashed) {
+      right_hash.reserve(size);
+    }
+    reserve_filters(size);
+  }
+
+  void index_node(storage_node& node) noexcept {
+    if constexpr (left_struct::hashed) {
+      left_hash.insert(node);
+    }
+    if constexpr (right_struct::hashed) {
+      right_hash.insert(node);
+    }
+    filter_update(node, 1);
+  }
+
+  void unindex_node(storage_node& node) noexcept {
+    if constexpr (left_struct::hashed) {
+      left_hash.erase(node);
+    }
+    if constexpr (right_struct::hashed) {
+      right_hash.erase(node);
+    }
+    filter_update(node, -1);
+  }
+
+  void clear_indexes() noexcept {
+    if constexpr (left_struct::hashed) {
+      left_hash.clear();
+    }
+    if constexpr (right_struct::hashed) {
+      right_hash.clear();
+    }
+    refill_filters();
+  }
+
+  // Lookups behind find, lower_bound, at and erase by key, starting from the
+  // finger of their side when the finger cache is on. find answers from the
+  // lookup cache when the slot of key holds an equivalent key and skips the
+  // tree when the Bloom filter rules key out. Keys of hashed sides go to the
+  // hash index instead
+  template <typename Traits, typename K>
+  typename Traits::set::iterator find_in(const K& key) const noexcept {
+    using iterator = typename Traits::set::iterator;
+    if constexpr (Traits::hashed && std::is_same_v<K, typename Traits::key>) {
+      auto* node = hash_of<Traits>().find(
+          key, [this](const auto& stored, const auto& wanted) {
+            return equivalent<Traits>(wanted, stored);
+          });
+      return node ? iterator(node) : set_of<Traits>().end();
+    }
+    storage_node** slot = cache_slot<Traits>(key);
+    if (slot && *slot && equivalent<Traits>(key, Traits::getter::get(**slot))) {
+      cache_of<Traits>().hits++;
+      return iterator(*slot);
+    }
+    if (!may_contain<Traits>(key)) {
+      if (slot) {
+        cache_of<Traits>().misses++;
+      }
+      return set_of<Traits>().end();
+    }
+    iterator it = extras && extras->finger_cache
+                      ? set_of<Traits>().find_near(finger_of<Traits>(), key)
+                      : set_of<Traits>().find(key);
+    if (slot) {
+      cache_of<Traits>().misses++;
+      if (it != set_of<Traits>().end()) {
+        // under the hash of the stored key, which forget() clears, since an
+        // equivalent key may hash elsewhere
+        auto* node = static_cast<storage_node*>(&*it);
+        *cache_slot<Traits>(Traits::getter::get(*node)) = node;
+      }
+    }
+    return it;
+  }
+
+  template <typename Traits, typename K>
+  typename Traits::set::iterator lower_bound_in(const K& key) const noexcept {
+    if (extras && extras->finger_cache) {
+      return set_of<Traits>().lower_bound_near(finger_of<Traits>(), key);
+    }
+    return set_of<Traits>().lower_bound(key);
+  }
+
+  void forget_fingers() noexcept {
+    if (extras) {
+      extras->left_finger = {};
+      extras->right_finger = {};
+    }
+  }
+
+  // Drops the fingers and cache entries that point at node, which is being
+  // erased, and the node from the indexes
+  void forget(storage_node* node) noexcept {
+    unindex_node(*node);
+    if (!extras) {
+      return;
+    }
+    if (extras->left_finger == typename left_struct::set::iterator(node)) {
+      extras->left_finger = {};
+    }
+    if (extras->right_finger == typename right_struct::set::iterator(node)) {
+      extras->right_finger = {};
+    }
+    for (auto** slot : {cache_slot<left_struct>(node->left_key),
+                        cache_slot<right_struct>(node->right_key)}) {
+      if (slot && *slot == node) {
+        *slot = nullptr;
+      }
+    }
+  }
+
+  // Drops every finger and cache entry, before many pairs are erased at once
+  void forget() noexcept {
+    if (!extras) {
+      return;
+    }
+    forget_fingers();
+    for (auto* cache : {&extras->left_cache, &extras->right_cache}) {
+      std::fill(cache->slots.begin(), cache->slots.end(), nullptr);
+    }
+  }
+
+  template <typename Traits, typename K>
+  bool erase_key(const K& key) noexcept {
+    auto it = find_in<Traits>(key);
+    if (it == set_of<Traits>().end()) {
+      return false;
+    }
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      erase_left(left_iterator(it));
+    } else {
+      erase_right(right_iterator(it));
+    }
+    return true;
+  }
+
+  template <typename Traits, typename K>
+  const typename Traits::flip_struct::key& at_key(const K& key) const {
+    auto it = typename Traits::iterator(find_in<Traits>(key));
+    if (it == typename Traits::iterator(set_of<Traits>().end())) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return *it.flip();
+  }
+
+  template <typename Traits>
+  void translate(std::span<const typename Traits::key> keys,
+                 std::span<typename Traits::flip_struct::key> out) const {
+    using iterator = typename Traits::iterator;
+    bool missing = false;
+    set_of<Traits>().find_batch(
+        keys.data(), std::min(keys.size(), out.size()),
+        [&](std::size_t i, auto it) {
+          if (it == set_of<Traits>().end()) {
+            missing = true;
+          } else {
+            out[i] = *iterator(it).flip();
+          }
+        });
+    if (missing) {
+      throw std::out_of_range("element doesn't exist");
+    }
+  }
+
+  // Whether touching all n nodes once is cheaper than k separate descents
+  bool prefer_linear(std::size_t k) const noexcept {
+    return k * std::bit_width(m_size) >= m_size;
+  }
+
+  template <typename Set>
+  static void insert_by_midpoints(Set& set, storage_node* const* first,
+                                  storage_node* const* last) noexcept {
+    // keeps the unbalanced tree from turning sorted runs into chains
+    if (first == last) {
+      return;
+    }
+    auto mid = first + (last - first) / 2;
+    set.insert(**mid, true);
+    insert_by_midpoints(set, first, mid);
+    insert_by_midpoints(set, mid + 1, last);
+  }
+
+  // Groups batch indices by equivalent keys: group[i] is the first index of
+  // the group in sorted order, taken[group] says whether the key is in set
+  template <typename Traits, typename Proj>
+  void group_keys(const typename Traits::set& set, std::size_t size,
+                  Proj proj, std::vector<std::size_t>& order,
+                  std::vector<std::size_t>& group,
+                  std::vector<bool>& taken) const {
+    using iterator = typename Traits::iterator;
+    auto comp = [&set](const auto& left, const auto& right) {
+      return intrusive::details::compare_less(
+          static_cast<const typename Traits::compare&>(set), left, right);
+    };
+    order.resize(size);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) {
+                       return comp(proj(a), proj(b));
+                     });
+    group.resize(size);
+    taken.assign(size, false);
+    bool linear = prefer_linear(size);
+    auto it = iterator(set.begin());
+    auto end = iterator(set.end());
+    for (std::size_t i = 0; i < size; i++) {
+      const auto& key = proj(order[i]);
+      if (i != 0 && !comp(proj(order[i - 1]), key)) {
+        group[order[i]] = group[order[i - 1]];
+        continue;
+      }
+      group[order[i]] = order[i];
+      if (linear) {
+        while (it != end && comp(*it, key)) {
+          ++it;
+        }
+      } else {
+        it = iterator(set.lower_bound(key));
+      }
+      taken[order[i]] = it != end && !comp(key, *it);
+    }
+  }
+
+  // Detaches the range from set in O(height) and then removes its k nodes from
+  // the other tree either one by one or, for large k, in one linear pass
+  template <typename Traits>
+  void erase_range(typename Traits::set& set,
+                   typename Traits::flip_struct::set& other,
+                   typename Traits::set::iterator first,
+                   typename Traits::set::iterator last) noexcept {
+    using other_iterator = typename Traits::flip_struct::set::iterator;
+    using other_base = typename Traits::flip_struct::base_node;
+    forget();
+    if (first == set.begin() && last == set.end()) {
+      // nothing survives, so the other tree can be dropped without unlinking
+      other.clear();
+      set.erase(first, last,
+                [](storage_node& node) { destroy_node(&node); });
+      m_size = 0;
+      clear_indexes();
+      return;
+    }
+    std::size_t count = std::distance(first, last);
+    if (prefer_linear(count)) {
+      set.erase(first, last, [](storage_node&) {});
+      other.erase_if(
+          [](const storage_node& node) {
+            return !static_cast<const typename Traits::base_node&>(node)
+                        .is_linked();
+          },
+          [this](storage_node& node) {
+            unindex_node(node);
+            destroy_node(&node);
+          });
+    } else {
+      set.erase(first, last, [this, &other](storage_node& node) {
+        other.erase(other_iterator(static_cast<other_base*>(&node)));
+        unindex_node(node);
+        destroy_node(&node);
+      });
+    }
+    m_size -= count;
+  }
+
+  template <typename Pred>
+  std::size_t erase_pairs_if(Pred& pred) {
+    std::vector<storage_node*> victims;
+    for (auto it = begin_left(); it != end_left(); ++it) {
+      if (pred(*it, *it.flip())) {
+        victims.push_back(&static_cast<storage_node&>(*it.it));
+      }
+    }
+    if (!prefer_linear(victims.size())) {
+      for (auto* victim : victims) {
+        erase_left(left_iterator(typename left_struct::set::iterator(
+            static_cast<typename left_struct::base_node*>(victim))));
+      }
+      return victims.size();
+    }
+    forget();
+    left_set.erase_if(
+        [&victims, i = std::size_t{0}](const storage_node& node) mutable {
+          if (i < victims.size() && victims[i] == &node) {
+            i++;
+            return true;
+          }
+          return false;
+        },
+        [](storage_node&) {});
+    right_set.erase_if(
+        [](const storage_node& node) {
+          return !static_cast<const typename left_struct::base_node&>(node)
+                      .is_linked();
+        },
+        [this](storage_node& node) {
+          unindex_node(node);
+          destroy_node(&node);
+        });
+    m_size -= victims.size();
+    return victims.size();
   }
 
 public:
@@ -196,76 +931,282 @@ public:
     return perfect_forwarding_insert(std::move(left), std::move(right));
   };
 
+  // Inserts the pairs of the batch as sequential insert calls would, but sorts
+  // it per side first and links all accepted pairs in one pass over each tree.
+  // Returns pairs rejected due to the map or earlier pairs in batch order
+  std::vector<std::pair<left_t, right_t>>
+  insert_batch(std::span<const std::pair<left_t, right_t>> batch) {
+    std::vector<std::size_t> by_left, by_right, left_group, right_group;
+    std::vector<bool> left_taken, right_taken;
+    group_keys<left_struct>(
+        left_set, batch.size(),
+        [&](std::size_t i) -> const left_t& { return batch[i].first; },
+        by_left, left_group, left_taken);
+    group_keys<right_struct>(
+        right_set, batch.size(),
+        [&](std::size_t i) -> const right_t& { return batch[i].second; },
+        by_right, right_group, right_taken);
+
+    std::vector<std::pair<left_t, right_t>> rejected;
+    std::vector<bool> accepted(batch.size());
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      if (left_taken[left_group[i]] || right_taken[right_group[i]]) {
+        rejected.push_back(batch[i]);
+      } else {
+        left_taken[left_group[i]] = right_taken[right_group[i]] = true;
+        accepted[i] = true;
+        count++;
+      }
+    }
+
+    std::vector<storage_node*> nodes(batch.size()), left_sorted, right_sorted;
+    left_sorted.reserve(count);
+    right_sorted.reserve(count);
+    reserve_indexes(m_size + count);
+    try {
+      for (std::size_t i = 0; i < batch.size(); i++) {
+        if (accepted[i]) {
+          nodes[i] = make_node(batch[i].first, batch[i].second);
+        }
+      }
+    } catch (...) {
+      for (auto* node : nodes) {
+        destroy_node(node);
+      }
+      throw;
+    }
+
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      if (nodes[i]) {
+        index_node(*nodes[i]);
+      }
+      if (nodes[by_left[i]]) {
+        left_sorted.push_back(nodes[by_left[i]]);
+      }
+      if (nodes[by_right[i]]) {
+        right_sorted.push_back(nodes[by_right[i]]);
+      }
+    }
+    if (prefer_linear(count)) {
+      left_set.merge_sorted(left_sorted.begin(), left_sorted.end());
+      right_set.merge_sorted(right_sorted.begin(), right_sorted.end());
+    } else {
+      insert_by_midpoints(left_set, left_sorted.data(),
+                          left_sorted.data() + count);
+      insert_by_midpoints(right_set, right_sorted.data(),
+                          right_sorted.data() + count);
+    }
+    m_size += count;
+    return rejected;
+  }
+
   left_iterator erase_left(left_iterator it) noexcept {
+    forget(static_cast<storage_node*>(&*it.it));
     right_set.erase(it.flip().it);
     auto copy = it++;
     auto next = left_iterator(it.it);
-    delete static_cast<storage_node*>(left_set.erase(copy.it));
+    destroy_node(static_cast<storage_node*>(left_set.erase(copy.it)));
     m_size--;
     return next;
   };
 
   bool erase_left(const left_t& left) noexcept {
-    auto it = find_left(left);
-    if (it != end_left()) {
-      erase_left(it);
-      return true;
-    }
-    return false;
+    return erase_key<left_struct>(left);
   };
 
+  template <typename K>
+    requires transparent_key<K, left_struct>
+  bool erase_left(const K& left) noexcept {
+    return erase_key<left_struct>(left);
+  }
+
   right_iterator erase_right(right_iterator it) noexcept {
+    forget(static_cast<storage_node*>(&*it.it));
     left_set.erase(it.flip().it);
     auto copy = it++;
     auto next = right_iterator(it.it);
-    delete static_cast<storage_node*>(right_set.erase(copy.it));
+    destroy_node(static_cast<storage_node*>(right_set.erase(copy.it)));
     m_size--;
     return next;
   };
 
   bool erase_right(const right_t& right) noexcept {
-    auto it = find_right(right);
-    if (it != end_right()) {
-      erase_right(it);
-      return true;
-    }
-    return false;
+    return erase_key<right_struct>(right);
   };
 
+  template <typename K>
+    requires transparent_key<K, right_struct>
+  bool erase_right(const K& right) noexcept {
+    return erase_key<right_struct>(right);
+  }
+
   left_iterator erase_left(left_iterator first, left_iterator last) noexcept {
-    for (auto it = first; it != last; it = erase_left(it)) {}
+    erase_range<left_struct>(left_set, right_set, first.it, last.it);
     return last;
   };
 
   right_iterator erase_right(right_iterator first,
                              right_iterator last) noexcept {
-    for (auto it = first; it != last; it = erase_right(it)) {}
+    erase_range<right_struct>(right_set, left_set, first.it, last.it);
     return last;
   };
 
+  // With the finger cache on, each side remembers the node its last find,
+  // lower_bound, at or erase by key ended at and starts the next search of
+  // that side there, so runs of nearby keys take a few node visits each.
+  // Erasing a pair drops the fingers pointing at it. Const lookups then write
+  // the fingers and must not run concurrently
+  void enable_finger_cache(bool enabled = true) {
+    accelerate().finger_cache = enabled;
+    forget_fingers();
+  }
+
+  struct lookup_cache_stats {
+    std::size_t hits;
+    std::size_t misses;
+  };
+
+  // Puts a direct-mapped cache of slots entries in front of each side whose
+  // key has a std::hash and is ordered by std::less or std::greater. find, at
+  // and erase by key on that side answer from it when the slot of the key
+  // holds the key and otherwise remember the node they found in the slot of
+  // its stored key. Erasing a pair clears its entries. 0 slots turns the
+  // caches off. Like the finger cache it is written by const lookups
+  void enable_lookup_cache(std::size_t slots = 4096) {
+    slots = slots ? std::bit_ceil(std::max<std::size_t>(slots, 2)) : 0;
+    auto& state = accelerate();
+    state.left_cache = front_cache(left_hashable ? slots : 0);
+    state.right_cache = front_cache(right_hashable ? slots : 0);
+  }
+
+  lookup_cache_stats left_cache_stats() const noexcept {
+    if (!extras) {
+      return {0, 0};
+    }
+    return {extras->left_cache.hits, extras->left_cache.misses};
+  }
+
+  lookup_cache_stats right_cache_stats() const noexcept {
+    if (!extras) {
+      return {0, 0};
+    }
+    return {extras->right_cache.hits, extras->right_cache.misses};
+  }
+
+  // Keeps a counting Bloom filter of the keys of each side that has a
+  // std::hash and is ordered by std::less or std::greater, so find, at and
+  // erase by key of absent keys mostly return without descending the tree.
+  // Inserts still descend for their position
+  void enable_bloom_filter(bool enabled = true) {
+    auto& state = accelerate();
+    state.bloom_filter = enabled && (left_hashable || right_hashable);
+    state.left_filter.blocks.clear();
+    state.right_filter.blocks.clear();
+    reserve_filters(m_size);
+  }
+
   left_iterator find_left(const left_t& left) const noexcept {
-    return left_iterator(left_set.find(left));
+    return left_iterator(find_in<left_struct>(left));
   };
+
+  template <typename K>
+    requires transparent_key<K, left_struct>
+  left_iterator find_left(const K& left) const noexcept {
+    return left_iterator(find_in<left_struct>(left));
+  }
+
   right_iterator find_right(const right_t& right) const noexcept {
-    return right_iterator(right_set.find(right));
+    return right_iterator(find_in<right_struct>(right));
   };
 
+  template <typename K>
+    requires transparent_key<K, right_struct>
+  right_iterator find_right(const K& right) const noexcept {
+    return right_iterator(find_in<right_struct>(right));
+  }
+
+  // find_left one tree level per step(), for lookups that interleave
+  // descents, such as coro::async_find. Goes past the caches and the hash
+  // index. key must outlive the descent
+  auto find_left_stepwise(const left_t& key) const noexcept {
+    return stepwise_find<left_struct>{left_set.find_stepwise(key)};
+  }
+
+  auto find_right_stepwise(const right_t& key) const noexcept {
+    return stepwise_find<right_struct>{right_set.find_stepwise(key)};
+  }
+
+  // Finds keys[i] into out[i] for every i, interleaving the descents of
+  // several keys to overlap their cache misses
+  void find_left_batch(std::span<const left_t> keys,
+                       std::span<left_iterator> out) const noexcept {
+    left_set.find_batch(keys.data(), std::min(keys.size(), out.size()),
+                        [&out](std::size_t i, auto it) {
+                          out[i] = left_iterator(it);
+                        });
+  }
+
+  void find_right_batch(std::span<const right_t> keys,
+                        std::span<right_iterator> out) const noexcept {
+    right_set.find_batch(keys.data(), std::min(keys.size(), out.size()),
+                         [&out](std::size_t i, auto it) {
+                           out[i] = right_iterator(it);
+                         });
+  }
+
+  // Finds keys[i] into out[i] for keys sorted by the side's comparator.
+  // Each search starts from the previous hit and climbs only as high as
+  // needed, so m dense probes cost about O(m log(n / m))
+  void find_left_sorted(std::span<const left_t> keys,
+                        std::span<left_iterator> out) const noexcept {
+    left_set.find_sorted(keys.data(), std::min(keys.size(), out.size()),
+                         [&out](std::size_t i, auto it) {
+                           out[i] = left_iterator(it);
+                         });
+  }
+
+  void find_right_sorted(std::span<const right_t> keys,
+                         std::span<right_iterator> out) const noexcept {
+    right_set.find_sorted(keys.data(), std::min(keys.size(), out.size()),
+                          [&out](std::size_t i, auto it) {
+                            out[i] = right_iterator(it);
+                          });
+  }
+
+  // Writes at_left(keys[i]) into out[i] for every i the way find_left_batch
+  // looks keys up. Throws out_of_range if some key is missing, leaving out
+  // partially written
+  void translate_left(std::span<const left_t> keys,
+                      std::span<right_t> out) const {
+    translate<left_struct>(keys, out);
+  }
+
+  void translate_right(std::span<const right_t> keys,
+                       std::span<left_t> out) const {
+    translate<right_struct>(keys, out);
+  }
+
   right_t const& at_left(const left_t& key) const {
-    auto left_it = find_left(key);
-    if (left_it == end_left()) {
-      throw std::out_of_range("element doesn't exist");
-    }
-    return *left_it.flip();
+    return at_key<left_struct>(key);
   };
 
+  template <typename K>
+    requires transparent_key<K, left_struct>
+  right_t const& at_left(const K& key) const {
+    return at_key<left_struct>(key);
+  }
+
   left_t const& at_right(const right_t& key) const {
-    auto right_it = find_right(key);
-    if (right_it == end_right()) {
-      throw std::out_of_range("element doesn't exist");
-    }
-    return *right_it.flip();
+    return at_key<right_struct>(key);
   };
 
+  template <typename K>
+    requires transparent_key<K, right_struct>
+  left_t const& at_right(const K& key) const {
+    return at_key<right_struct>(key);
+  }
+
   // Возвращает противоположный элемент по элементу
   // Если элемента не существует, добавляет его в bimap и на противоположную
   // сторону кладет дефолтный элемент, ссылку на который и возвращает
@@ -299,21 +1240,45 @@ public:
   }
 
   left_iterator lower_bound_left(const left_t& left) const noexcept {
-    return left_iterator(left_set.lower_bound(left));
+    return left_iterator(lower_bound_in<left_struct>(left));
   };
 
+  template <typename K>
+    requires transparent_key<K, left_struct>
+  left_iterator lower_bound_left(const K& left) const noexcept {
+    return left_iterator(lower_bound_in<left_struct>(left));
+  }
+
   left_iterator upper_bound_left(const left_t& left) const noexcept {
     return left_iterator(left_set.upper_bound(left));
   };
 
+  template <typename K>
+    requires transparent_key<K, left_struct>
+  left_iterator upper_bound_left(const K& left) const noexcept {
+    return left_iterator(left_set.upper_bound(left));
+  }
+
   right_iterator lower_bound_right(const right_t& right) const noexcept {
-    return right_iterator(right_set.lower_bound(right));
+    return right_iterator(lower_bound_in<right_struct>(right));
   };
 
+  template <typename K>
+    requires transparent_key<K, right_struct>
+  right_iterator lower_bound_right(const K& right) const noexcept {
+    return right_iterator(lower_bound_in<right_struct>(right));
+  }
+
   right_iterator upper_bound_right(const right_t& right) const noexcept {
     return right_iterator(right_set.upper_bound(right));
   };
 
+  template <typename K>
+    requires transparent_key<K, right_struct>
+  right_iterator upper_bound_right(const K& right) const noexcept {
+    return right_iterator(right_set.upper_bound(right));
+  }
+
   left_iterator begin_left() const noexcept {
     return left_iterator(left_set.begin());
   };
@@ -338,13 +1303,27 @@ public:
     return m_size;
   };
 
+  // Immutable compact copy of the pairs, for lookups from many threads
+  template <template <typename> class Index = eytzinger_index>
+  frozen_bimap<Left, Right, CompareLeft, CompareRight, Index> freeze() const {
+    return {begin_left(), end_left(),
+            static_cast<const CompareLeft&>(left_set),
+            static_cast<const CompareRight&>(right_set)};
+  }
+
   friend bool operator==(bimap const& a, bimap const& b) noexcept {
     if (a.size() != b.size()) {
       return false;
     }
 
-    const CompareLeft& comp_left = a.left_set;
-    const CompareRight& comp_right = a.right_set;
+    auto comp_left = [&a](const left_t& left, const left_t& right) {
+      return intrusive::details::compare_less(
+          static_cast<const CompareLeft&>(a.left_set), left, right);
+    };
+    auto comp_right = [&a](const right_t& left, const right_t& right) {
+      return intrusive::details::compare_less(
+          static_cast<const CompareRight&>(a.right_set), left, right);
+    };
 
     for (auto it1 = a.begin_left(), it2 = b.begin_left(); it2 != b.end_left();
          it1++, it2++) {
@@ -361,9 +1340,20 @@ public:
     return !(a == b);
   };
 
+  // Erases all pairs for which pred(left, right) holds. Pred is called once
+  // per pair in left order, then the victims leave both trees in one linear
+  // pass each. Returns the number of erased pairs
+  template <typename Pred>
+  friend std::size_t erase_if(bimap& b, Pred pred) {
+    return b.erase_pairs_if(pred);
+  }
+
 private:
   bimap_based_node sentinel;
   std::size_t m_size{};
+  std::unique_ptr<accelerators> extras;
+  [[no_unique_address]] typename left_struct::hash_set left_hash;
+  [[no_unique_address]] typename right_struct::hash_set right_hash;
   typename left_struct::set left_set;
   typename right_struct::set right_set;
 };
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace coro {
+
+template <typename T>
+struct task;
+
+struct scheduler;
+
+namespace details {
+
+// Lookup frames are small, short-lived and allocated at a high rate, so
+// freed frames are kept per thread and per 64-byte size class
+struct frame_pool {
+  static constexpr std::size_t granularity = 64;
+  static constexpr std::size_t classes = 16;
+
+  struct free_frame {
+    free_frame* next;
+  };
+
+  free_frame* heads[classes]{};
+
+  ~frame_pool() {
+    for (auto* head : heads) {
+      while (head) {
+        ::operator delete(std::exchange(head, head->next));
+      }
+    }
+  }
+
+  static frame_pool& local() noexcept {
+    thread_local frame_pool pool;
+    return pool;
+  }
+
+  static void* allocate(std::size_t size) {
+    std::size_t size_class = (size + granularity - 1) / granularity;
+    if (size_class >= classes) {
+      return ::operator new(size);
+    }
+    auto& head = local().heads[size_class];
+    if (head) {
+      return std::exchange(head, head->next);
+    }
+    return ::operator new(size_class * granularity);
+  }
+
+  static void deallocate(void* frame, std::size_t size) noexcept {
+    std::size_t size_class = (size + granularity - 1) / granularity;
+    if (size_class >= classes) {
+      ::operator delete(frame);
+      return;
+    }
+    auto& head = local().heads[size_class];
+    head = new (frame) free_frame{head};
+  }
+};
+
+// Resumes the task that awaited the finished one, if any
+struct final_awaiter {
+  bool await_ready() noexcept {
+    return false;
+  }
+
+  template <typename Promise>
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+    auto continuation = handle.promise().continuation;
+    return continuation ? continuation : std::noop_coroutine();
+  }
+
+  void await_resume() noexcept {}
+};
+
+// Starts the awaited task in the chain of the awaiting one
+template <typename Promise>
+struct task_awaiter {
+  std::coroutine_handle<Promise> handle;
+
+  bool await_ready() noexcept {
+    return false;
+  }
+
+  template <typename AwaitingPromise>
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<AwaitingPromise> awaiting) noexcept {
+    handle.promise().resume_point = awaiting.promise().resume_point;
+    handle.promise().continuation = awaiting;
+    return handle;
+  }
+
+  decltype(auto) await_resume() {
+    return handle.promise().result();
+  }
+};
+
+struct promise_base {
+  // Where the scheduler resumes the chain of tasks this one belongs to. Null
+  // when the chain runs outside of a scheduler
+  std::coroutine_handle<>* resume_point = nullptr;
+  std::coroutine_handle<> continuation;
+  std::exception_ptr exception;
+
+  static void* operator new(std::size_t size) {
+    return frame_pool::allocate(size);
+  }
+
+  static void operator delete(void* frame, std::size_t size) noexcept {
+    frame_pool::deallocate(frame, size);
+  }
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+
+  final_awaiter final_suspend() noexcept {
+    return {};
+  }
+
+  void unhandled_exception() noexcept {
+    exception = std::current_exception();
+  }
+};
+
+template <typename T>
+struct promise : promise_base {
+  std::optional<T> value;
+
+  task<T> get_return_object() noexcept;
+
+  template <typename U>
+  void return_value(U&& result) {
+    value.emplace(std::forward<U>(result));
+  }
+
+  T result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+    return std::move(*value);
+  }
+};
+
+template <>
+struct promise<void> : promise_base {
+  task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {}
+
+  void result() {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+};
+
+} // namespace details
+
+// Lazily started coroutine. Awaiting it from another task runs it inside the
+// awaiting chain, so it is suspended and resumed along with the chain
+template <typename T = void>
+struct task {
+  using promise_type = details::promise<T>;
+
+  task(task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+  task& operator=(task&& other) noexcept {
+    if (this != &other) {
+      task(std::move(other)).swap(*this);
+    }
+    return *this;
+  }
+
+  ~task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  void swap(task& other) noexcept {
+    std::swap(handle, other.handle);
+  }
+
+  details::task_awaiter<promise_type> operator co_await() && noexcept {
+    return {handle};
+  }
+
+private:
+  friend promise_type;
+  friend scheduler;
+
+  task() noexcept = default;
+
+  explicit task(std::coroutine_handle<promise_type> handle_) noexcept
+      : handle(handle_) {}
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+namespace details {
+
+template <typename T>
+task<T> promise<T>::get_return_object() noexcept {
+  return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept {
+  return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} // namespace details
+
+// Issues prefetches for the node a descent is about to read and yields to the
+// scheduler, which resumes other lookups while the memory is on its way.
+// Outside of a scheduler it doesn't suspend at all
+struct prefetch {
+  explicit prefetch(const void* first, const void* second = nullptr) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(first);
+    if (second) {
+      __builtin_prefetch(second);
+    }
+#else
+    (void)first;
+    (void)second;
+#endif
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> handle) const noexcept {
+    auto* resume_point = handle.promise().resume_point;
+    if (!resume_point) {
+      return false;
+    }
+    *resume_point = handle;
+    return true;
+  }
+
+  void await_resume() const noexcept {}
+};
+
+// Runs a stepwise descent, such as intrusive_set::find_stepwise or
+// bimap::find_left_stepwise hand out, prefetching and yielding before each
+// node it reads. The key of the descent must outlive the returned task
+template <typename Descent>
+auto async_find(Descent descent) -> task<decltype(descent.result())> {
+  while (const void* node = descent.next()) {
+    co_await prefetch(node, descent.next_key());
+    descent.step();
+  }
+  co_return descent.result();
+}
+
+// Runs spawned tasks round-robin with at most width of them in flight,
+// switching task whenever one of them waits for a prefetch. Tasks may only
+// suspend on prefetch and on other tasks
+struct scheduler {
+  explicit scheduler(std::size_t width = 16) : slots(width ? width : 1) {}
+
+  scheduler(const scheduler&) = delete;
+
+  scheduler& operator=(const scheduler&) = delete;
+
+  void spawn(task<void> root) {
+    pending.push_back(std::move(root));
+  }
+
+  // Runs until every spawned task is done. Rethrows the first exception that
+  // escaped a task once all of them finished
+  void run() {
+    std::exception_ptr exception;
+    std::size_t running = 0;
+    do {
+      running = 0;
+      for (auto& slot : slots) {
+        if (!slot.root.handle && !pending.empty()) {
+          slot.root = std::move(pending.front());
+          pending.pop_front();
+          slot.root.handle.promise().resume_point = &slot.next;
+          slot.next = slot.root.handle;
+        }
+        if (!slot.root.handle) {
+          continue;
+        }
+        std::exchange(slot.next, {}).resume();
+        if (slot.root.handle.done()) {
+          if (slot.root.handle.promise().exception && !exception) {
+            exception = slot.root.handle.promise().exception;
+          }
+          slot.root = task<void>();
+        } else {
+          running++;
+        }
+      }
+    } while (running != 0 || !pending.empty());
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+private:
+  struct slot {
+    task<void> root;
+    std::coroutine_handle<> next;
+  };
+
+  std::vector<slot> slots;
+  std::deque<task<void>> pending;
+};
+
+} // namespace coro
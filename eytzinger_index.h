@@ -0,0 +1,238 @@
+#pragma once
+
+#include "intrusive_set.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <immintrin.h>
+#define BIMAP_X86_KERNELS 1
+#endif
+
+namespace simd {
+
+// Keeps the blocks that the kernels load whole within one cache line each
+template <typename T>
+struct cache_line_allocator {
+  using value_type = T;
+
+  cache_line_allocator() = default;
+
+  template <typename U>
+  cache_line_allocator(const cache_line_allocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(
+        ::operator new(n * sizeof(T), std::align_val_t(64)));
+  }
+
+  void deallocate(T* p, std::size_t) noexcept {
+    ::operator delete(p, std::align_val_t(64));
+  }
+
+  friend bool operator==(const cache_line_allocator&,
+                         const cache_line_allocator&) noexcept {
+    return true;
+  }
+};
+
+// Number of the 64 / sizeof(Key) keys of a block that are less than key
+template <typename Key>
+using count_less_kernel = std::size_t (*)(const Key*, Key) noexcept;
+
+template <typename Key>
+std::size_t count_less_scalar(const Key* block, Key key) noexcept {
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < 64 / sizeof(Key); i++) {
+    count += block[i] < key;
+  }
+  return count;
+}
+
+#ifdef BIMAP_X86_KERNELS
+// The compares are signed, so unsigned keys get their top bit flipped first
+template <typename Key>
+[[gnu::target("avx2")]] std::size_t count_less_avx2(const Key* block,
+                                                    Key key) noexcept {
+  auto words = reinterpret_cast<const __m256i*>(block);
+  if constexpr (sizeof(Key) == 4) {
+    __m256i bias = _mm256_set1_epi32(
+        std::is_signed_v<Key> ? 0 : std::numeric_limits<int32_t>::min());
+    __m256i probe =
+        _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(key)), bias);
+    __m256i low = _mm256_xor_si256(_mm256_load_si256(words), bias);
+    __m256i high = _mm256_xor_si256(_mm256_load_si256(words + 1), bias);
+    __m256i below = _mm256_packs_epi32(_mm256_cmpgt_epi32(probe, low),
+                                       _mm256_cmpgt_epi32(probe, high));
+    // each key below the probe sets two bits of the byte mask
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(below));
+    return static_cast<std::size_t>(std::popcount(mask)) / 2;
+  } else {
+    __m256i bias = _mm256_set1_epi64x(
+        std::is_signed_v<Key> ? 0 : std::numeric_limits<int64_t>::min());
+    __m256i probe =
+        _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(key)), bias);
+    __m256i low = _mm256_xor_si256(_mm256_load_si256(words), bias);
+    __m256i high = _mm256_xor_si256(_mm256_load_si256(words + 1), bias);
+    __m256i below = _mm256_packs_epi32(_mm256_cmpgt_epi64(probe, low),
+                                       _mm256_cmpgt_epi64(probe, high));
+    // each key below the probe sets four bits of the byte mask
+    auto mask = static_cast<unsigned>(_mm256_movemask_epi8(below));
+    return static_cast<std::size_t>(std::popcount(mask)) / 4;
+  }
+}
+
+// SSE2 is in every x86-64, but has no 64-bit compare
+template <typename Key>
+std::size_t count_less_sse2(const Key* block, Key key) noexcept {
+  static_assert(sizeof(Key) == 4);
+  auto words = reinterpret_cast<const __m128i*>(block);
+  __m128i bias = _mm_set1_epi32(
+      std::is_signed_v<Key> ? 0 : std::numeric_limits<int32_t>::min());
+  __m128i probe =
+      _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(key)), bias);
+  unsigned mask = 0;
+  for (int i = 0; i < 4; i++) {
+    __m128i keys = _mm_xor_si128(_mm_load_si128(words + i), bias);
+    mask |= static_cast<unsigned>(_mm_movemask_ps(
+                _mm_castsi128_ps(_mm_cmpgt_epi32(probe, keys))))
+            << (4 * i);
+  }
+  return static_cast<std::size_t>(std::popcount(mask));
+}
+#endif
+
+// The widest kernel that the CPU running the program supports
+template <typename Key>
+count_less_kernel<Key> pick_count_less() noexcept {
+#ifdef BIMAP_X86_KERNELS
+  if constexpr (sizeof(Key) == 4 || sizeof(Key) == 8) {
+    if (__builtin_cpu_supports("avx2")) {
+      return count_less_avx2<Key>;
+    }
+  }
+  if constexpr (sizeof(Key) == 4) {
+    return count_less_sse2<Key>;
+  }
+#endif
+  return count_less_scalar<Key>;
+}
+
+} // namespace simd
+
+// Search index over distinct sorted integers. Every 64 / sizeof(Key)-th key
+// is in a perfect tree in Eytzinger (breadth-first) order, where the
+// descendants of a node that fill a cache line, four levels down for 32-bit
+// keys and three for 64-bit ones, share one that the descent prefetches
+// ahead, and where the position of a node in key order follows
+// from its number. The descent picks a block of the sorted keys, which are
+// padded to whole cache lines, and a kernel counts the block's keys below the
+// probe with vector compares. The kernel is chosen for the CPU at runtime,
+// with a scalar one for CPUs without vector compares
+template <typename Key>
+struct eytzinger_index {
+  static_assert(std::is_integral_v<Key> && !std::is_same_v<Key, bool>,
+                "the index compares keys as integers");
+
+  eytzinger_index() = default;
+
+  // Index of the sorted distinct keys between first and last
+  template <typename Iterator>
+  eytzinger_index(Iterator first, Iterator last) {
+    if constexpr (std::forward_iterator<Iterator>) {
+      // with room for the padding
+      auto size = static_cast<std::size_t>(std::distance(first, last));
+      sorted.reserve((size + block - 1) / block * block);
+    }
+    for (; first != last; ++first) {
+      sorted.push_back(*first);
+    }
+    count = sorted.size();
+    sorted.resize((count + block - 1) / block * block,
+                  std::numeric_limits<Key>::max());
+    samples = sorted.size() / block;
+    height = static_cast<std::size_t>(std::bit_width(samples));
+    // the samples past the last one are the largest key, like the padding
+    tree.resize(std::size_t(1) << height, std::numeric_limits<Key>::max());
+    std::size_t next = 0;
+    build(1, next);
+  }
+
+  // Number of keys less than key
+  std::size_t lower_bound(Key key) const noexcept {
+    if (count == 0) {
+      return 0;
+    }
+    std::size_t k = 1;
+    for (std::size_t level = 0; level < height; level++) {
+      // the line of descendants from node block * k on, and past the tree
+      // near the leaves, which a prefetch doesn't mind
+      intrusive::details::prefetch(reinterpret_cast<const void*>(
+          reinterpret_cast<std::uintptr_t>(tree.data()) +
+          block * k * sizeof(Key)));
+      k = 2 * k + (tree[k] < key);
+    }
+    // the last step to the left was from the first sample not less than key
+    k >>= std::countr_one(k) + 1;
+    std::size_t first = k == 0 ? samples : std::min(sample_of(k), samples);
+    if (first == 0) {
+      return 0;
+    }
+    std::size_t base = (first - 1) * block;
+    return base + kernel(sorted.data() + base, key);
+  }
+
+  // Number of keys not greater than key
+  std::size_t upper_bound(Key key) const noexcept {
+    if (key == std::numeric_limits<Key>::max()) {
+      return count;
+    }
+    return lower_bound(static_cast<Key>(key + 1));
+  }
+
+  // Position of key, or size() if there is no such key
+  std::size_t find(Key key) const noexcept {
+    std::size_t pos = lower_bound(key);
+    return pos < count && sorted[pos] == key ? pos : count;
+  }
+
+  std::size_t size() const noexcept {
+    return count;
+  }
+
+private:
+  static constexpr std::size_t block = 64 / sizeof(Key);
+
+  // Position in key order of node k, which is the i-th node of its level
+  std::size_t sample_of(std::size_t k) const noexcept {
+    std::size_t depth = static_cast<std::size_t>(std::bit_width(k)) - 1;
+    std::size_t i = k - (std::size_t(1) << depth);
+    return ((2 * i + 1) << (height - depth - 1)) - 1;
+  }
+
+  // Fills the subtree of node k with the samples from next on, in order
+  void build(std::size_t k, std::size_t& next) noexcept {
+    if (k < tree.size()) {
+      build(2 * k, next);
+      if (next < samples) {
+        tree[k] = sorted[next * block];
+      }
+      next++;
+      build(2 * k + 1, next);
+    }
+  }
+
+  std::vector<Key, simd::cache_line_allocator<Key>> sorted;
+  std::vector<Key, simd::cache_line_allocator<Key>> tree;
+  std::size_t count = 0;
+  std::size_t samples = 0;
+  std::size_t height = 0;
+  simd::count_less_kernel<Key> kernel = simd::pick_count_less<Key>();
+};
@@ -0,0 +1,700 @@
+#pragma once
+
+#include "inline_string.h"
+#include "intrusive_set.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Tags input in left order without equivalent keys, like std::sorted_unique
+struct sorted_unique_t {
+  explicit sorted_unique_t() = default;
+};
+
+inline constexpr sorted_unique_t sorted_unique{};
+
+// Bimap of two contiguous arrays of keys in left order plus the slots in right
+// order and the inverse permutation, which flip() goes through. Lookups are
+// binary searches over arrays, so the map suits maps that are built once and
+// read a lot. An insert or an erase moves the pairs after it and invalidates
+// iterators, like those of a sorted vector, so build with insert_batch, which
+// sorts the batch and merges it in one pass
+template <typename Left, typename Right,
+          typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+struct flat_bimap {
+private:
+  using left_t = Left;
+  using right_t = Right;
+  using index_t = std::uint32_t;
+
+  static constexpr bool nothrow_move =
+      std::is_nothrow_move_constructible_v<Left> &&
+      std::is_nothrow_move_constructible_v<Right>;
+
+  static constexpr bool inline_keys =
+      std::is_same_v<Left, inline_string> ||
+      std::is_same_v<Right, inline_string>;
+
+  struct no_store {};
+
+  // Erases shift the pairs after them down by move assignment
+  static constexpr bool nothrow_shift =
+      std::is_nothrow_move_assignable_v<Left> &&
+      std::is_nothrow_move_assignable_v<Right>;
+
+  template <typename T>
+  struct template_iterator;
+
+  struct right_struct;
+
+  struct left_struct {
+    using key = left_t;
+    using compare = CompareLeft;
+    using iterator = template_iterator<left_struct>;
+    using flip_struct = right_struct;
+  };
+
+  struct right_struct {
+    using key = right_t;
+    using compare = CompareRight;
+    using iterator = template_iterator<right_struct>;
+    using flip_struct = left_struct;
+  };
+
+  template <typename Traits>
+  struct template_iterator {
+  private:
+    friend struct flat_bimap;
+
+    template <typename U>
+    friend struct template_iterator;
+
+    const flat_bimap* map = nullptr;
+    // slot for left iterators and rank in right order for right ones
+    std::size_t pos = 0;
+
+    template_iterator(const flat_bimap* map_, std::size_t pos_) noexcept
+        : map(map_), pos(pos_) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename Traits::key;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    template_iterator() = default;
+
+    reference operator*() const noexcept {
+      return map->key_of<Traits>(map->slot_of<Traits>(pos));
+    }
+
+    pointer operator->() const noexcept {
+      return &operator*();
+    }
+
+    template_iterator& operator++() noexcept {
+      pos++;
+      return *this;
+    }
+
+    template_iterator operator++(int) noexcept {
+      auto tmp = *this;
+      pos++;
+      return tmp;
+    }
+
+    template_iterator& operator--() noexcept {
+      pos--;
+      return *this;
+    }
+
+    template_iterator operator--(int) noexcept {
+      auto tmp = *this;
+      pos--;
+      return tmp;
+    }
+
+    typename Traits::flip_struct::iterator flip() const noexcept {
+      using flip_struct = typename Traits::flip_struct;
+      if (pos == map->size()) {
+        return {map, pos};
+      }
+      return {map, map->pos_of<flip_struct>(map->slot_of<Traits>(pos))};
+    }
+
+    friend bool operator==(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.pos == right.pos;
+    }
+
+    friend bool operator!=(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.pos != right.pos;
+    }
+  };
+
+public:
+  using left_iterator = typename left_struct::iterator;
+
+  using right_iterator = typename right_struct::iterator;
+
+  flat_bimap(CompareLeft compare_left = CompareLeft(),
+             CompareRight compare_right = CompareRight())
+      : left_compare(std::move(compare_left)),
+        right_compare(std::move(compare_right)) {}
+
+  // The pairs between left iterators first and last of a map, which are in
+  // left order and unique, so only the right order needs sorting. The map
+  // keeps copies of the characters of inline_string keys, which would
+  // otherwise point into the nodes of the source
+  template <typename LeftIterator>
+  flat_bimap(sorted_unique_t, LeftIterator first, LeftIterator last,
+             CompareLeft compare_left = CompareLeft(),
+             CompareRight compare_right = CompareRight())
+      : left_compare(std::move(compare_left)),
+        right_compare(std::move(compare_right)) {
+    if constexpr (std::random_access_iterator<LeftIterator>) {
+      reserve(static_cast<std::size_t>(last - first));
+    }
+    for (; first != last; ++first) {
+      lefts.push_back(*first);
+      rights.push_back(*first.flip());
+    }
+    // walking a tree twice to count it first would cost more than a copy
+    lefts.shrink_to_fit();
+    rights.shrink_to_fit();
+    if constexpr (inline_keys) {
+      chars.adopt([this](auto visit) {
+        std::for_each(lefts.begin(), lefts.end(), visit);
+        std::for_each(rights.begin(), rights.end(), visit);
+      });
+    }
+    check_size(size());
+    right_order.resize(size());
+    right_rank.resize(size());
+    std::iota(right_order.begin(), right_order.end(), index_t(0));
+    std::sort(right_order.begin(), right_order.end(),
+              [this](index_t a, index_t b) {
+                return less<right_struct>(rights[a], rights[b]);
+              });
+    rank_slots();
+  }
+
+  void swap(flat_bimap& other) noexcept {
+    using std::swap;
+    swap(left_compare, other.left_compare);
+    swap(right_compare, other.right_compare);
+    lefts.swap(other.lefts);
+    rights.swap(other.rights);
+    right_order.swap(other.right_order);
+    right_rank.swap(other.right_rank);
+    swap(chars, other.chars);
+  }
+
+  // Shifts the pairs after the new one, so each insert takes O(n). Many
+  // pairs go through insert_batch or the range insert instead
+  left_iterator insert(const left_t& left, const right_t& right) {
+    return perfect_forwarding_insert(left, right);
+  }
+
+  left_iterator insert(const left_t& left, right_t&& right) {
+    return perfect_forwarding_insert(left, std::move(right));
+  }
+
+  left_iterator insert(left_t&& left, const right_t& right) {
+    return perfect_forwarding_insert(std::move(left), right);
+  }
+
+  left_iterator insert(left_t&& left, right_t&& right) {
+    return perfect_forwarding_insert(std::move(left), std::move(right));
+  }
+
+  // Inserts the pairs of the batch as sequential insert calls would, but
+  // sorts it per side first and merges the accepted pairs into the arrays in
+  // one pass. Returns pairs rejected due to the map or earlier pairs in batch
+  // order
+  std::vector<std::pair<left_t, right_t>>
+  insert_batch(std::span<const std::pair<left_t, right_t>> batch) {
+    std::vector<std::size_t> by_left, by_right, left_group, right_group;
+    std::vector<bool> left_taken, right_taken;
+    group_keys<left_struct>(
+        batch.size(),
+        [&](std::size_t i) -> const left_t& { return batch[i].first; },
+        by_left, left_group, left_taken);
+    group_keys<right_struct>(
+        batch.size(),
+        [&](std::size_t i) -> const right_t& { return batch[i].second; },
+        by_right, right_group, right_taken);
+
+    std::vector<std::pair<left_t, right_t>> rejected;
+    std::vector<bool> accepted(batch.size());
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      if (left_taken[left_group[i]] || right_taken[right_group[i]]) {
+        rejected.push_back(batch[i]);
+        continue;
+      }
+      left_taken[left_group[i]] = right_taken[right_group[i]] = true;
+      accepted[i] = true;
+      count++;
+    }
+    std::erase_if(by_left, [&](std::size_t i) { return !accepted[i]; });
+    std::erase_if(by_right, [&](std::size_t i) { return !accepted[i]; });
+    merge(batch, by_left, by_right, count);
+    return rejected;
+  }
+
+  // insert_batch over the pairs in [first, last), so that the whole range
+  // takes one sort and one merge
+  template <std::input_iterator InputIt>
+  std::vector<std::pair<left_t, right_t>> insert(InputIt first,
+                                                 InputIt last) {
+    std::vector<std::pair<left_t, right_t>> batch(first, last);
+    return insert_batch(batch);
+  }
+
+  left_iterator erase_left(left_iterator it) noexcept(nothrow_shift) {
+    erase_slot(it.pos);
+    return it;
+  }
+
+  bool erase_left(const left_t& left) noexcept(nothrow_shift) {
+    return erase_key<left_struct>(left);
+  }
+
+  left_iterator erase_left(left_iterator first,
+                           left_iterator last) noexcept(nothrow_shift) {
+    erase_slots([&](std::size_t slot) {
+      return slot >= first.pos && slot < last.pos;
+    });
+    return first;
+  }
+
+  right_iterator erase_right(right_iterator it) noexcept(nothrow_shift) {
+    erase_slot(right_order[it.pos]);
+    return it;
+  }
+
+  bool erase_right(const right_t& right) noexcept(nothrow_shift) {
+    return erase_key<right_struct>(right);
+  }
+
+  right_iterator erase_right(right_iterator first,
+                             right_iterator last) noexcept(nothrow_shift) {
+    erase_slots([&](std::size_t slot) {
+      return right_rank[slot] >= first.pos && right_rank[slot] < last.pos;
+    });
+    return first;
+  }
+
+  void clear() noexcept {
+    lefts.clear();
+    rights.clear();
+    right_order.clear();
+    right_rank.clear();
+  }
+
+  // Makes room for size pairs, so that inserts up to it don't reallocate
+  void reserve(std::size_t size) {
+    lefts.reserve(size);
+    rights.reserve(size);
+    right_order.reserve(size);
+    right_rank.reserve(size);
+  }
+
+  left_iterator find_left(const left_t& left) const noexcept {
+    return find<left_struct>(left);
+  }
+
+  right_iterator find_right(const right_t& right) const noexcept {
+    return find<right_struct>(right);
+  }
+
+  right_t const& at_left(const left_t& key) const {
+    return at_key<left_struct>(key);
+  }
+
+  left_t const& at_right(const right_t& key) const {
+    return at_key<right_struct>(key);
+  }
+
+  left_iterator lower_bound_left(const left_t& left) const noexcept {
+    return {this, rank<left_struct>(left, false)};
+  }
+
+  left_iterator upper_bound_left(const left_t& left) const noexcept {
+    return {this, rank<left_struct>(left, true)};
+  }
+
+  right_iterator lower_bound_right(const right_t& right) const noexcept {
+    return {this, rank<right_struct>(right, false)};
+  }
+
+  right_iterator upper_bound_right(const right_t& right) const noexcept {
+    return {this, rank<right_struct>(right, true)};
+  }
+
+  // Iterators to the pos-th pair of each order, for indexes that count keys
+  left_iterator nth_left(std::size_t pos) const noexcept {
+    return {this, pos};
+  }
+
+  right_iterator nth_right(std::size_t pos) const noexcept {
+    return {this, pos};
+  }
+
+  left_iterator begin_left() const noexcept {
+    return {this, 0};
+  }
+
+  left_iterator end_left() const noexcept {
+    return {this, size()};
+  }
+
+  right_iterator begin_right() const noexcept {
+    return {this, 0};
+  }
+
+  right_iterator end_right() const noexcept {
+    return {this, size()};
+  }
+
+  bool empty() const noexcept {
+    return lefts.empty();
+  }
+
+  std::size_t size() const noexcept {
+    return lefts.size();
+  }
+
+  friend bool operator==(const flat_bimap& a, const flat_bimap& b) noexcept {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+      auto other = b.find_left(*it);
+      if (other == b.end_left() ||
+          !b.template equivalent<right_struct>(*other.flip(), *it.flip())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const flat_bimap& a, const flat_bimap& b) noexcept {
+    return !(a == b);
+  }
+
+private:
+  template <typename Traits>
+  const typename Traits::compare& compare_of() const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return left_compare;
+    } else {
+      return right_compare;
+    }
+  }
+
+  template <typename Traits, typename L, typename R>
+  bool less(const L& left, const R& right) const noexcept {
+    return intrusive::details::compare_less(compare_of<Traits>(), left,
+                                            right);
+  }
+
+  template <typename Traits>
+  bool equivalent(const typename Traits::key& a,
+                  const typename Traits::key& b) const noexcept {
+    return !less<Traits>(a, b) && !less<Traits>(b, a);
+  }
+
+  template <typename Traits>
+  const typename Traits::key& key_of(std::size_t slot) const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return lefts[slot];
+    } else {
+      return rights[slot];
+    }
+  }
+
+  // Slot at position pos of the Traits order and back
+  template <typename Traits>
+  std::size_t slot_of(std::size_t pos) const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return pos;
+    } else {
+      return right_order[pos];
+    }
+  }
+
+  template <typename Traits>
+  std::size_t pos_of(std::size_t slot) const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return slot;
+    } else {
+      return right_rank[slot];
+    }
+  }
+
+  template <typename Traits>
+  typename Traits::iterator end_of() const noexcept {
+    return {this, size()};
+  }
+
+  // Number of keys less than key, or not greater with upper. The halving
+  // step is a conditional add rather than a branch, so that it doesn't
+  // mispredict on every other probe
+  template <typename Traits>
+  std::size_t rank(const typename Traits::key& key,
+                   bool upper) const noexcept {
+    auto before = [&](std::size_t pos) {
+      const auto& probe = key_of<Traits>(slot_of<Traits>(pos));
+      return upper ? !less<Traits>(key, probe) : less<Traits>(probe, key);
+    };
+    std::size_t len = size();
+    if (len == 0) {
+      return 0;
+    }
+    std::size_t first = 0;
+    while (len > 1) {
+      std::size_t half = len / 2;
+      first += before(first + half - 1) ? half : 0;
+      len -= half;
+    }
+    return first + before(first);
+  }
+
+  template <typename Traits>
+  typename Traits::iterator
+  find(const typename Traits::key& key) const noexcept {
+    std::size_t pos = rank<Traits>(key, false);
+    if (pos < size() &&
+        !less<Traits>(key, key_of<Traits>(slot_of<Traits>(pos)))) {
+      return {this, pos};
+    }
+    return end_of<Traits>();
+  }
+
+  template <typename Traits>
+  bool erase_key(const typename Traits::key& key) noexcept(nothrow_shift) {
+    auto it = find<Traits>(key);
+    if (it == end_of<Traits>()) {
+      return false;
+    }
+    erase_slot(slot_of<Traits>(it.pos));
+    return true;
+  }
+
+  template <typename Traits>
+  const typename Traits::flip_struct::key&
+  at_key(const typename Traits::key& key) const {
+    auto it = find<Traits>(key);
+    if (it == end_of<Traits>()) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return *it.flip();
+  }
+
+  void check_size(std::size_t size) const {
+    if (size > std::numeric_limits<index_t>::max()) {
+      throw std::length_error("flat_bimap is too large");
+    }
+  }
+
+  template <typename L, typename R>
+  left_iterator perfect_forwarding_insert(L&& left, R&& right) {
+    std::size_t slot = rank<left_struct>(left, false);
+    std::size_t order = rank<right_struct>(right, false);
+    if ((slot < size() && !less<left_struct>(left, lefts[slot])) ||
+        (order < size() &&
+         !less<right_struct>(right, rights[right_order[order]]))) {
+      return end_left();
+    }
+    check_size(size() + 1);
+    // with the room reserved only the keys' constructors can throw
+    if (size() == lefts.capacity()) {
+      reserve(std::max<std::size_t>(2 * size(), 8));
+    }
+    lefts.insert(lefts.begin() + slot, std::forward<L>(left));
+    try {
+      rights.insert(rights.begin() + slot, std::forward<R>(right));
+    } catch (...) {
+      lefts.erase(lefts.begin() + slot);
+      throw;
+    }
+    for (auto& index : right_order) {
+      index += index >= slot;
+    }
+    right_order.insert(right_order.begin() + order,
+                       static_cast<index_t>(slot));
+    right_rank.push_back(0);
+    rank_slots();
+    return {this, slot};
+  }
+
+  void erase_slot(std::size_t slot) noexcept(nothrow_shift) {
+    right_order.erase(right_order.begin() + right_rank[slot]);
+    lefts.erase(lefts.begin() + slot);
+    rights.erase(rights.begin() + slot);
+    for (auto& index : right_order) {
+      index -= index > slot;
+    }
+    right_rank.pop_back();
+    rank_slots();
+  }
+
+  // Erases the pairs of the slots that doomed picks in one pass over the
+  // arrays. doomed may read the right_rank of the slot it is given, which
+  // then turns into the new slot of the pair, or erased
+  template <typename Pred>
+  void erase_slots(Pred doomed) noexcept(nothrow_shift) {
+    constexpr index_t erased = std::numeric_limits<index_t>::max();
+    std::size_t kept = 0;
+    for (std::size_t slot = 0; slot < size(); slot++) {
+      if (doomed(slot)) {
+        right_rank[slot] = erased;
+        continue;
+      }
+      if (kept != slot) {
+        lefts[kept] = std::move(lefts[slot]);
+        rights[kept] = std::move(rights[slot]);
+      }
+      right_rank[slot] = static_cast<index_t>(kept++);
+    }
+    std::size_t pos = 0;
+    for (index_t slot : right_order) {
+      if (right_rank[slot] != erased) {
+        right_order[pos++] = right_rank[slot];
+      }
+    }
+    lefts.erase(lefts.begin() + static_cast<std::ptrdiff_t>(kept),
+                lefts.end());
+    rights.erase(rights.begin() + static_cast<std::ptrdiff_t>(kept),
+                 rights.end());
+    right_order.resize(kept);
+    right_rank.resize(kept);
+    rank_slots();
+  }
+
+  // Inverts right_order into right_rank
+  void rank_slots() noexcept {
+    for (std::size_t pos = 0; pos < right_order.size(); pos++) {
+      right_rank[right_order[pos]] = static_cast<index_t>(pos);
+    }
+  }
+
+  // Sorts indices below size by the keys that proj gives, finds the group of
+  // equivalent keys of each index, named after its first index in batch
+  // order, and whether the map already has the group's key
+  template <typename Traits, typename Proj>
+  void group_keys(std::size_t size, Proj proj, std::vector<std::size_t>& order,
+                  std::vector<std::size_t>& group,
+                  std::vector<bool>& taken) const {
+    order.resize(size);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) {
+                       return less<Traits>(proj(a), proj(b));
+                     });
+    group.resize(size);
+    taken.assign(size, false);
+    for (std::size_t i = 0; i < size; i++) {
+      const auto& key = proj(order[i]);
+      if (i != 0 && !less<Traits>(proj(order[i - 1]), key)) {
+        group[order[i]] = group[order[i - 1]];
+        continue;
+      }
+      group[order[i]] = order[i];
+      taken[order[i]] = find<Traits>(key) != end_of<Traits>();
+    }
+  }
+
+  // Merges the count pairs of the batch whose indices by_left and by_right
+  // list in left and right order into new arrays, which replace the old ones
+  // only once they are complete. The batch keys are copied before any key of
+  // the map moves, and keys whose moves may throw are copied instead, so a
+  // throw leaves the map as it was
+  void merge(std::span<const std::pair<left_t, right_t>> batch,
+             const std::vector<std::size_t>& by_left,
+             const std::vector<std::size_t>& by_right, std::size_t count) {
+    if (count == 0) {
+      return;
+    }
+    std::size_t total = size() + count;
+    check_size(total);
+    // keys move only once both orders are known, as the merges compare them
+    std::vector<std::size_t> source;
+    std::vector<index_t> new_order, new_rank(total), moved(size());
+    std::vector<index_t> placed(batch.size());
+    source.reserve(total);
+    new_order.reserve(total);
+    for (std::size_t slot = 0, i = 0; slot < size() || i < count;) {
+      if (i == count ||
+          (slot < size() &&
+           less<left_struct>(lefts[slot], batch[by_left[i]].first))) {
+        moved[slot] = static_cast<index_t>(source.size());
+        source.push_back(slot++);
+      } else {
+        placed[by_left[i]] = static_cast<index_t>(source.size());
+        source.push_back(size() + i++);
+      }
+    }
+    for (std::size_t pos = 0, i = 0; pos < size() || i < count;) {
+      if (i == count ||
+          (pos < size() && less<right_struct>(rights[right_order[pos]],
+                                              batch[by_right[i]].second))) {
+        new_order.push_back(moved[right_order[pos++]]);
+      } else {
+        new_order.push_back(placed[by_right[i++]]);
+      }
+    }
+    std::vector<left_t> added_lefts, new_lefts;
+    std::vector<right_t> added_rights, new_rights;
+    added_lefts.reserve(count);
+    added_rights.reserve(count);
+    for (std::size_t i : by_left) {
+      added_lefts.push_back(batch[i].first);
+      added_rights.push_back(batch[i].second);
+    }
+    new_lefts.reserve(total);
+    new_rights.reserve(total);
+    for (std::size_t from : source) {
+      if (from >= size()) {
+        new_lefts.push_back(std::move_if_noexcept(added_lefts[from - size()]));
+        new_rights.push_back(
+            std::move_if_noexcept(added_rights[from - size()]));
+      } else if constexpr (nothrow_move) {
+        new_lefts.push_back(std::move(lefts[from]));
+        new_rights.push_back(std::move(rights[from]));
+      } else {
+        new_lefts.push_back(lefts[from]);
+        new_rights.push_back(rights[from]);
+      }
+    }
+    lefts.swap(new_lefts);
+    rights.swap(new_rights);
+    right_order.swap(new_order);
+    right_rank.swap(new_rank);
+    rank_slots();
+  }
+
+  [[no_unique_address]] CompareLeft left_compare;
+  [[no_unique_address]] CompareRight right_compare;
+  std::vector<left_t> lefts;
+  std::vector<right_t> rights;
+  std::vector<index_t> right_order;
+  std::vector<index_t> right_rank;
+  [[no_unique_address]] std::conditional_t<inline_keys, inline_string_store,
+                                           no_store>
+      chars;
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "eytzinger_index.h"
+#include "flat_bimap.h"
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Immutable snapshot of a bimap, as bimap::freeze() makes. The pairs are in
+// a flat_bimap that is built once with room for exactly them: the keys in
+// left order, the permutation of slots in right order and its inverse, so a
+// bimap<uint32_t, uint32_t> takes 16 bytes per pair. Integer sides ordered
+// by std::less whose keys outgrow the L2 cache also get an Index, which
+// lookups and bounds of the side go through: by default an eytzinger_index,
+// or a learned_index for smooth keys. Either keeps its own copy of the keys
+// of the side, laid out for its search, so an indexed side costs a bit more
+// than a key more per pair, and a frozen_bimap<uint32_t, uint32_t> indexed
+// on both sides takes about 25 bytes per pair. Nothing changes the map after
+// construction, so threads can share it without locks
+template <typename Left, typename Right,
+          typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>,
+          template <typename> class Index = eytzinger_index>
+struct frozen_bimap {
+private:
+  using left_t = Left;
+  using right_t = Right;
+  using flat_t = flat_bimap<Left, Right, CompareLeft, CompareRight>;
+
+  template <typename Key, typename Compare>
+  static constexpr bool indexed =
+      std::is_integral_v<Key> && !std::is_same_v<Key, bool> &&
+      (std::is_same_v<Compare, std::less<Key>> ||
+       std::is_same_v<Compare, std::less<>>);
+
+  struct no_index {};
+
+  template <typename Key, typename Compare>
+  using index_for =
+      std::conditional_t<indexed<Key, Compare>, Index<Key>, no_index>;
+
+  static constexpr bool left_indexed = indexed<Left, CompareLeft>;
+  static constexpr bool right_indexed = indexed<Right, CompareRight>;
+
+  // Binary search over smaller arrays runs from cache and wins
+  static constexpr std::size_t index_bytes = std::size_t(1) << 20;
+
+public:
+  using left_iterator = typename flat_t::left_iterator;
+
+  using right_iterator = typename flat_t::right_iterator;
+
+  frozen_bimap(CompareLeft compare_left = CompareLeft(),
+               CompareRight compare_right = CompareRight())
+      : flat(std::move(compare_left), std::move(compare_right)) {}
+
+  // Snapshot of the pairs between left iterators first and last of a map
+  template <typename LeftIterator>
+  frozen_bimap(LeftIterator first, LeftIterator last,
+               CompareLeft compare_left = CompareLeft(),
+               CompareRight compare_right = CompareRight())
+      : flat(sorted_unique, first, last, std::move(compare_left),
+             std::move(compare_right)) {
+    if constexpr (left_indexed) {
+      if (size() * sizeof(left_t) >= index_bytes) {
+        left_index = {flat.begin_left(), flat.end_left()};
+      }
+    }
+    if constexpr (right_indexed) {
+      if (size() * sizeof(right_t) >= index_bytes) {
+        right_index = {flat.begin_right(), flat.end_right()};
+      }
+    }
+  }
+
+  left_iterator find_left(const left_t& left) const noexcept {
+    if constexpr (left_indexed) {
+      if (left_index.size() != 0) {
+        return flat.nth_left(left_index.find(left));
+      }
+    }
+    return flat.find_left(left);
+  }
+
+  right_iterator find_right(const right_t& right) const noexcept {
+    if constexpr (right_indexed) {
+      if (right_index.size() != 0) {
+        return flat.nth_right(right_index.find(right));
+      }
+    }
+    return flat.find_right(right);
+  }
+
+  right_t const& at_left(const left_t& key) const {
+    auto it = find_left(key);
+    if (it == end_left()) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return *it.flip();
+  }
+
+  left_t const& at_right(const right_t& key) const {
+    auto it = find_right(key);
+    if (it == end_right()) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return *it.flip();
+  }
+
+  left_iterator lower_bound_left(const left_t& left) const noexcept {
+    if constexpr (left_indexed) {
+      if (left_index.size() != 0) {
+        return flat.nth_left(left_index.lower_bound(left));
+      }
+    }
+    return flat.lower_bound_left(left);
+  }
+
+  left_iterator upper_bound_left(const left_t& left) const noexcept {
+    if constexpr (left_indexed) {
+      if (left_index.size() != 0) {
+        return flat.nth_left(left_index.upper_bound(left));
+      }
+    }
+    return flat.upper_bound_left(left);
+  }
+
+  right_iterator lower_bound_right(const right_t& right) const noexcept {
+    if constexpr (right_indexed) {
+      if (right_index.size() != 0) {
+        return flat.nth_right(right_index.lower_bound(right));
+      }
+    }
+    return flat.lower_bound_right(right);
+  }
+
+  right_iterator upper_bound_right(const right_t& right) const noexcept {
+    if constexpr (right_indexed) {
+      if (right_index.size() != 0) {
+        return flat.nth_right(right_index.upper_bound(right));
+      }
+    }
+    return flat.upper_bound_right(right);
+  }
+
+  left_iterator begin_left() const noexcept {
+    return flat.begin_left();
+  }
+
+  left_iterator end_left() const noexcept {
+    return flat.end_left();
+  }
+
+  right_iterator begin_right() const noexcept {
+    return flat.begin_right();
+  }
+
+  right_iterator end_right() const noexcept {
+    return flat.end_right();
+  }
+
+  bool empty() const noexcept {
+    return flat.empty();
+  }
+
+  std::size_t size() const noexcept {
+    return flat.size();
+  }
+
+  friend bool operator==(const frozen_bimap& a,
+                         const frozen_bimap& b) noexcept {
+    return a.flat == b.flat;
+  }
+
+  friend bool operator!=(const frozen_bimap& a,
+                         const frozen_bimap& b) noexcept {
+    return a.flat != b.flat;
+  }
+
+private:
+  flat_t flat;
+  [[no_unique_address]] index_for<Left, CompareLeft> left_index;
+  [[no_unique_address]] index_for<Right, CompareRight> right_index;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+
+// Key type for string keys stored in the node itself: bimap allocates a node
+// and the characters of its inline_string keys at once, right after the tree
+// links, and the key is an immutable view of them. Inserting any string
+// copies its characters, so views passed in needn't outlive the call
+struct inline_string : std::string_view {
+  constexpr inline_string() noexcept = default;
+
+  template <typename S>
+    requires std::convertible_to<const S&, std::string_view>
+  constexpr inline_string(const S& s) noexcept : std::string_view(s) {}
+
+  constexpr inline_string(const char* data, std::size_t size) noexcept
+      : std::string_view(data, size) {}
+};
+
+template <>
+struct std::hash<inline_string> : std::hash<std::string_view> {};
+
+// Characters of the inline_string keys of a container that copies keys out
+// of a bimap, so that they outlive its nodes. Copies of the container share
+// the block, which nothing writes after adopt
+struct inline_string_store {
+  // Copies the characters of the inline_string keys that for_each_key(visit)
+  // passes to visit into one block and points the keys at them. Other keys
+  // are skipped
+  template <typename ForEachKey>
+  void adopt(ForEachKey for_each_key) {
+    std::size_t bytes = 0;
+    for_each_key([&bytes](auto& key) {
+      if constexpr (std::is_same_v<std::remove_cvref_t<decltype(key)>,
+                                   inline_string>) {
+        bytes += key.size();
+      }
+    });
+    std::shared_ptr<char[]> block = std::make_shared<char[]>(bytes);
+    char* next = block.get();
+    for_each_key([&next](auto& key) {
+      if constexpr (std::is_same_v<std::remove_cvref_t<decltype(key)>,
+                                   inline_string>) {
+        if (!key.empty()) {
+          std::memcpy(next, key.data(), key.size());
+        }
+        key = inline_string(next, key.size());
+        next += key.size();
+      }
+    });
+    chars = std::move(block);
+  }
+
+private:
+  std::shared_ptr<const char[]> chars;
+};
@@ -0,0 +1,333 @@
+#pragma once
+
+#include "intrusive_set.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bimap between keys and dense ids 0, 1, ... that it assigns itself, as for
+// dictionary encoding. Keys are in a search tree, ids index a vector of the
+// nodes, so at_right(id) is one load. Ids of erased keys are reused by later
+// interns. Iterators walk the keys in order and know their id
+template <typename Key, typename Compare = std::less<Key>,
+          typename Id = std::uint32_t>
+struct interning_bimap {
+  static_assert(std::is_unsigned_v<Id>, "ids are unsigned integers");
+
+private:
+  struct tag_for_key;
+
+  struct storage_node;
+
+  struct getter {
+    static const Key& get(const storage_node& storage_node) noexcept {
+      return storage_node.key;
+    }
+  };
+
+  using base_node = intrusive::node<tag_for_key>;
+  using set = intrusive::intrusive_set<storage_node, Key, tag_for_key,
+                                       Compare, getter>;
+
+  struct storage_node : base_node {
+  public:
+    Key key;
+    Id id;
+
+    template <typename K>
+    storage_node(K&& k, Id id_) : key(std::forward<K>(k)), id(id_) {}
+  };
+
+public:
+  struct iterator {
+  private:
+    friend struct interning_bimap;
+
+    typename set::iterator it;
+
+    explicit iterator(typename set::iterator it_) noexcept : it(it_) {}
+
+    const storage_node& node() const noexcept {
+      return static_cast<const storage_node&>(*it);
+    }
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Key;
+    using pointer = const Key*;
+    using reference = const Key&;
+
+    iterator() = default;
+
+    reference operator*() const noexcept {
+      return node().key;
+    }
+
+    pointer operator->() const noexcept {
+      return &node().key;
+    }
+
+    Id id() const noexcept {
+      return node().id;
+    }
+
+    iterator& operator++() noexcept {
+      ++it;
+      return *this;
+    }
+
+    iterator operator++(int) noexcept {
+      auto tmp = *this;
+      ++it;
+      return tmp;
+    }
+
+    iterator& operator--() noexcept {
+      --it;
+      return *this;
+    }
+
+    iterator operator--(int) noexcept {
+      auto tmp = *this;
+      --it;
+      return tmp;
+    }
+
+    friend bool operator==(const iterator& left,
+                           const iterator& right) noexcept {
+      return left.it == right.it;
+    }
+
+    friend bool operator!=(const iterator& left,
+                           const iterator& right) noexcept {
+      return left.it != right.it;
+    }
+  };
+
+  using left_iterator = iterator;
+
+  explicit interning_bimap(Compare compare = Compare())
+      : key_set(sentinel, std::move(compare)) {}
+
+  // Copies keep the ids, including the free ones
+  interning_bimap(const interning_bimap& other)
+      : key_set(sentinel, static_cast<Compare>(other.key_set)),
+        nodes(other.nodes.size(), nullptr) {
+    free_ids.reserve(other.free_ids.capacity());
+    free_ids = other.free_ids;
+    std::vector<storage_node*> sorted;
+    sorted.reserve(other.size());
+    try {
+      for (auto it = other.begin_left(); it != other.end_left(); ++it) {
+        sorted.push_back(new storage_node(*it, it.id()));
+        nodes[it.id()] = sorted.back();
+      }
+    } catch (...) {
+      for (auto* node : sorted) {
+        delete node;
+      }
+      throw;
+    }
+    key_set.merge_sorted(sorted.begin(), sorted.end());
+  }
+
+  interning_bimap& operator=(const interning_bimap& other) {
+    if (&other != this) {
+      interning_bimap(other).swap(*this);
+    }
+    return *this;
+  }
+
+  ~interning_bimap() noexcept {
+    clear();
+  }
+
+  void swap(interning_bimap& other) noexcept {
+    key_set.swap(other.key_set);
+    nodes.swap(other.nodes);
+    free_ids.swap(other.free_ids);
+  }
+
+  // Id of key, which gets a free id or a new one if it isn't there yet
+  Id intern(const Key& key) {
+    return perfect_forwarding_intern(key);
+  }
+
+  Id intern(Key&& key) {
+    return perfect_forwarding_intern(std::move(key));
+  }
+
+  iterator find_left(const Key& key) const noexcept {
+    return iterator(key_set.find(key));
+  }
+
+  // Key with the id, or end_left() for ids that are free or never assigned
+  iterator find_right(Id id) const noexcept {
+    if (id < nodes.size() && nodes[id]) {
+      return iterator(typename set::iterator(nodes[id]));
+    }
+    return end_left();
+  }
+
+  Id at_left(const Key& key) const {
+    auto it = find_left(key);
+    if (it == end_left()) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return it.id();
+  }
+
+  const Key& at_right(Id id) const {
+    if (id >= nodes.size() || !nodes[id]) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return nodes[id]->key;
+  }
+
+  iterator lower_bound_left(const Key& key) const noexcept {
+    return iterator(key_set.lower_bound(key));
+  }
+
+  iterator upper_bound_left(const Key& key) const noexcept {
+    return iterator(key_set.upper_bound(key));
+  }
+
+  iterator erase_left(iterator it) noexcept {
+    auto next = std::next(it);
+    erase_node(static_cast<storage_node*>(&*it.it));
+    return next;
+  }
+
+  bool erase_left(const Key& key) noexcept {
+    auto it = find_left(key);
+    if (it == end_left()) {
+      return false;
+    }
+    erase_left(it);
+    return true;
+  }
+
+  bool erase_right(Id id) noexcept {
+    auto it = find_right(id);
+    if (it == end_left()) {
+      return false;
+    }
+    erase_left(it);
+    return true;
+  }
+
+  void clear() noexcept {
+    for (auto* node : nodes) {
+      delete node;
+    }
+    key_set.clear();
+    nodes.clear();
+    free_ids.clear();
+  }
+
+  // Makes room for ids below size without reallocating
+  void reserve(std::size_t size) {
+    free_ids.reserve(size);
+    nodes.reserve(size);
+  }
+
+  iterator begin_left() const noexcept {
+    return iterator(key_set.begin());
+  }
+
+  iterator end_left() const noexcept {
+    return iterator(key_set.end());
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  std::size_t size() const noexcept {
+    return nodes.size() - free_ids.size();
+  }
+
+  // Every assigned id is below id_bound()
+  std::size_t id_bound() const noexcept {
+    return nodes.size();
+  }
+
+  // Equal when the same keys have the same ids
+  friend bool operator==(const interning_bimap& a,
+                         const interning_bimap& b) noexcept {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+      auto other = b.find_left(*it);
+      if (other == b.end_left() || other.id() != it.id()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const interning_bimap& a,
+                         const interning_bimap& b) noexcept {
+    return !(a == b);
+  }
+
+private:
+  template <typename K>
+  Id perfect_forwarding_intern(K&& key) {
+    // one descent finds the key or the place for it
+    auto pos = key_set.find_insert_position(key);
+    if (pos.exists) {
+      return static_cast<const storage_node&>(*pos.existing).id;
+    }
+    Id id = take_id();
+    storage_node* node;
+    try {
+      node = new storage_node(std::forward<K>(key), id);
+    } catch (...) {
+      free_ids.push_back(id);
+      throw;
+    }
+    nodes[id] = node;
+    key_set.insert(*node, pos);
+    return id;
+  }
+
+  // A free id, or a new one past the others. free_ids keeps room for every
+  // id, so that erase never allocates
+  Id take_id() {
+    if (!free_ids.empty()) {
+      Id id = free_ids.back();
+      free_ids.pop_back();
+      return id;
+    }
+    if (nodes.size() > std::numeric_limits<Id>::max()) {
+      throw std::length_error("ids are exhausted");
+    }
+    if (free_ids.capacity() <= nodes.size()) {
+      free_ids.reserve(std::max<std::size_t>(2 * nodes.size(), 8));
+    }
+    nodes.push_back(nullptr);
+    return static_cast<Id>(nodes.size() - 1);
+  }
+
+  void erase_node(storage_node* node) noexcept {
+    key_set.erase(typename set::iterator(node));
+    nodes[node->id] = nullptr;
+    free_ids.push_back(node->id);
+    delete node;
+  }
+
+  base_node sentinel;
+  set key_set;
+  std::vector<storage_node*> nodes;
+  std::vector<Id> free_ids;
+};
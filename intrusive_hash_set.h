@@ -0,0 +1,164 @@
+#pragma once
+
+#include "intrusive_set.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace intrusive {
+
+template <typename T, typename Key, typename Tag, typename Hash,
+          typename Getter>
+struct intrusive_hash_set;
+
+template <typename Tag = default_tag>
+struct hash_node {
+public:
+  hash_node() noexcept = default;
+
+  hash_node(const hash_node&) = delete;
+
+  hash_node& operator=(const hash_node&) = delete;
+
+private:
+  hash_node* next{nullptr};
+  std::size_t hash{0};
+
+  template <typename T, typename Key, typename STag, typename Hash,
+            typename Getter>
+  friend struct intrusive_hash_set;
+};
+
+// Chained hash index over nodes that derive from hash_node<Tag>. Buckets are
+// singly linked through the nodes, which also keep their full hash, so
+// rehashing never calls Hash and a lookup compares keys only on equal hashes.
+// The index doesn't own its nodes and only allocates its bucket array
+template <typename T, typename Key, typename Tag = default_tag,
+          typename Hash = std::hash<Key>,
+          typename Getter = details::default_getter<T, Key>>
+struct intrusive_hash_set : Hash {
+private:
+  using node_t = hash_node<Tag>;
+
+  std::vector<node_t*> buckets;
+  int shift = 64;
+  std::size_t count = 0;
+
+  std::size_t bucket_of(std::size_t hash) const noexcept {
+    // Fibonacci hashing, so that identity hashes of integers spread too
+    return static_cast<std::size_t>(
+        (std::uint64_t{hash} * 0x9E3779B97F4A7C15ull) >> shift);
+  }
+
+public:
+  explicit intrusive_hash_set(Hash&& hash = Hash()) noexcept
+      : Hash(std::move(hash)) {}
+
+  intrusive_hash_set(const intrusive_hash_set&) = delete;
+
+  intrusive_hash_set& operator=(const intrusive_hash_set&) = delete;
+
+  void swap(intrusive_hash_set& other) noexcept {
+    std::swap(static_cast<Hash&>(*this), static_cast<Hash&>(other));
+    std::swap(buckets, other.buckets);
+    std::swap(shift, other.shift);
+    std::swap(count, other.count);
+  }
+
+  // Makes room for size nodes at a load factor of at most 1, so that inserts
+  // up to that size never allocate
+  void reserve(std::size_t size) {
+    if (size <= buckets.size()) {
+      return;
+    }
+    std::size_t new_size = std::bit_ceil(std::max<std::size_t>(size, 2));
+    std::vector<node_t*> old(new_size, nullptr);
+    old.swap(buckets);
+    shift = 64 - std::countr_zero(std::uint64_t{new_size});
+    for (node_t* head : old) {
+      while (head) {
+        node_t* next = std::exchange(head->next, nullptr);
+        link(head);
+        head = next;
+      }
+    }
+  }
+
+  // Requires reserve(size() + 1) beforehand
+  void insert(T& obj) noexcept {
+    node_t* node = &obj;
+    node->hash = Hash::operator()(Getter::get(obj));
+    link(node);
+    count++;
+  }
+
+  void erase(T& obj) noexcept {
+    node_t* node = &obj;
+    node_t** link = &buckets[bucket_of(node->hash)];
+    while (*link != node) {
+      link = &(*link)->next;
+    }
+    *link = node->next;
+    node->next = nullptr;
+    count--;
+  }
+
+  // Node with a key that eq reports equal to key, or null
+  template <typename Eq>
+  T* find(const Key& key, Eq&& eq) const noexcept {
+    if (buckets.empty()) {
+      return nullptr;
+    }
+    std::size_t hash = Hash::operator()(key);
+    for (node_t* node = buckets[bucket_of(hash)]; node; node = node->next) {
+      if (node->hash == hash && eq(Getter::get(*static_cast<T*>(node)), key)) {
+        return static_cast<T*>(node);
+      }
+    }
+    return nullptr;
+  }
+
+  // Nodes in table order: first() and next() walk the chain of a bucket and
+  // then the following non-empty buckets. The order changes on rehash
+  T* first() const noexcept {
+    return scan(0);
+  }
+
+  T* next(const T& obj) const noexcept {
+    const node_t* node = &obj;
+    if (node->next) {
+      return static_cast<T*>(node->next);
+    }
+    return scan(bucket_of(node->hash) + 1);
+  }
+
+  // Forgets all nodes without unlinking them, keeping the buckets
+  void clear() noexcept {
+    std::fill(buckets.begin(), buckets.end(), nullptr);
+    count = 0;
+  }
+
+  std::size_t size() const noexcept {
+    return count;
+  }
+
+private:
+  T* scan(std::size_t bucket) const noexcept {
+    for (; bucket < buckets.size(); bucket++) {
+      if (buckets[bucket]) {
+        return static_cast<T*>(buckets[bucket]);
+      }
+    }
+    return nullptr;
+  }
+
+  void link(node_t* node) noexcept {
+    node_t*& head = buckets[bucket_of(node->hash)];
+    node->next = head;
+    head = node;
+  }
+};
+
+} // namespace intrusive
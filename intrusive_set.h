@@ -1,10 +1,94 @@
 #pragma once
 
+#include <algorithm>
+#include <compare>
+#include <concepts>
+#include <cstddef>
 #include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 namespace intrusive {
 
 namespace details {
+// Comparators declaring is_transparent accept any key comparable with Key
+template <typename Compare>
+concept transparent = requires { typename Compare::is_transparent; };
+
+// Comparators returning an ordering (operator<=>, std::compare_three_way)
+// instead of bool decide between less, equal and greater in one call
+template <typename Compare, typename L, typename R = L>
+concept three_way = requires(const Compare& compare, const L& l, const R& r) {
+  { compare(l, r) } -> std::convertible_to<std::partial_ordering>;
+};
+
+template <typename Compare, typename L, typename R>
+bool compare_less(const Compare& compare, const L& left, const R& right) {
+  if constexpr (three_way<Compare, L, R>) {
+    return compare(left, right) < 0;
+  } else {
+    return compare(left, right);
+  }
+}
+
+// Comparators with a project(key) member order keys by that cheap projection
+// first: project(a) < project(b) must imply compare(a, b), so the comparator
+// is called only when projections tie. Nodes may cache their projection
+template <typename Compare, typename Key>
+concept projecting = requires(const Compare& compare, const Key& key) {
+  { compare.project(key) < compare.project(key) } -> std::convertible_to<bool>;
+};
+
+// Key searched for by a descent together with its projection, computed once
+template <typename K, typename P>
+struct projected {
+  const K& key;
+  P projection;
+};
+
+// Type of the projection a node caches for Compare, empty if there is none.
+// Tag keeps the empty projections of different sides of a node distinct, so
+// that both take no space
+template <typename Tag>
+struct no_projection {};
+
+template <typename Compare, typename Key, typename Tag = void>
+struct projection_of {
+  using type = no_projection<Tag>;
+};
+
+template <typename Compare, typename Key, typename Tag>
+  requires projecting<Compare, Key>
+struct projection_of<Compare, Key, Tag> {
+  using type = std::remove_cvref_t<decltype(
+      std::declval<const Compare&>().project(std::declval<const Key&>()))>;
+};
+
+template <typename Tag = void, typename Compare, typename Key>
+typename projection_of<Compare, Key, Tag>::type project(const Compare& compare,
+                                                        const Key& key) {
+  if constexpr (projecting<Compare, Key>) {
+    return compare.project(key);
+  } else {
+    return {};
+  }
+}
+
+template <typename Q>
+constexpr bool is_projected = false;
+
+template <typename K, typename P>
+constexpr bool is_projected<projected<K, P>> = true;
+
+inline void prefetch(const void* address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
 template <typename T, typename Key>
 struct default_getter {
   static const Key& get(const T& t) noexcept {
@@ -34,6 +118,10 @@ public:
 
   node& operator=(node&&) noexcept = default;
 
+  bool is_linked() const noexcept {
+    return parent != nullptr;
+  }
+
   static void set_child(node* old_node, node* new_node) noexcept {
     auto parent = old_node->parent;
     if (parent->left == old_node) {
@@ -69,16 +157,59 @@ private:
     return Getter::get(*static_cast<const T*>(node));
   }
 
-  bool less(const Key& left, const Key& right) const noexcept {
-    return Compare::operator()(left, right);
+  template <typename L, typename R>
+  bool less(const L& left, const R& right) const noexcept {
+    return details::compare_less(static_cast<const Compare&>(*this), left,
+                                 right);
   }
 
-  bool greater(const Key& left, const Key& right) const noexcept {
-    return Compare::operator()(right, left);
+  // Projection of a node key, cached in the node when Getter provides it
+  decltype(auto) get_projection(const node_t* node) const noexcept {
+    if constexpr (requires(const T& obj) { Getter::projection(obj); }) {
+      return Getter::projection(*static_cast<const T*>(node));
+    } else {
+      return Compare::project(get_key(node));
+    }
+  }
+
+  // What descents compare nodes with: key and its projection for projecting
+  // comparators, key itself otherwise
+  template <typename K>
+  decltype(auto) probe(const K& key) const noexcept {
+    if constexpr (details::projecting<Compare, Key> &&
+                  std::is_same_v<K, Key>) {
+      using projection = std::remove_cvref_t<decltype(Compare::project(key))>;
+      return details::projected<K, projection>{key, Compare::project(key)};
+    } else {
+      return (key);
+    }
+  }
+
+  // node key < q and q < node key, comparing projections before keys
+  template <typename Q>
+  bool node_less(const node_t* node, const Q& q) const noexcept {
+    if constexpr (details::is_projected<Q>) {
+      const auto& projection = get_projection(node);
+      if (projection < q.projection || q.projection < projection) {
+        return projection < q.projection;
+      }
+      return less(get_key(node), q.key);
+    } else {
+      return less(get_key(node), q);
+    }
   }
 
-  bool equals(const Key& left, const Key& right) const noexcept {
-    return !(greater(left, right) || less(left, right));
+  template <typename Q>
+  bool less_node(const Q& q, const node_t* node) const noexcept {
+    if constexpr (details::is_projected<Q>) {
+      const auto& projection = get_projection(node);
+      if (projection < q.projection || q.projection < projection) {
+        return q.projection < projection;
+      }
+      return less(q.key, get_key(node));
+    } else {
+      return less(q, get_key(node));
+    }
   }
 
 public:
@@ -194,16 +325,130 @@ public:
     }
   };
 
+  // Where a new key would be attached, found by the same descent that checks
+  // whether the key is already there and finds the node that holds it
+  struct insert_position {
+    node_t* parent;
+    node_t** link;
+    bool exists;
+    iterator existing;
+  };
+
+  template <typename K>
+  insert_position find_insert_position(const K& key) const noexcept {
+    insert_position pos{sentinel, &sentinel->left, false, end()};
+    node_t* candidate = sentinel;
+    auto&& q = probe(key);
+    while (node_t* node = *pos.link) {
+      pos.parent = node;
+      if (node_less(node, q)) {
+        pos.link = &node->right;
+      } else {
+        candidate = node;
+        pos.link = &node->left;
+      }
+    }
+    pos.exists = candidate != sentinel && !less_node(q, candidate);
+    if (pos.exists) {
+      pos.existing = iterator(candidate);
+    }
+    return pos;
+  }
+
+  // Links obj at a position found for its key, with no tree changes between
+  iterator insert(T& obj, insert_position pos) noexcept {
+    node_t* node = &obj;
+    *pos.link = node;
+    node->parent = pos.parent;
+    return iterator(node);
+  }
+
   iterator insert(T& obj, bool hint = false) noexcept {
-    if (!hint) {
-      auto it = find(Getter::get(obj));
-      if (it != end()) {
-        return end();
+    auto pos = find_insert_position(Getter::get(obj));
+    if (!hint && pos.exists) {
+      return end();
+    }
+    return insert(obj, pos);
+  }
+
+  // Links the nodes of [first, last), which must be sorted and absent from the
+  // set, and rebuilds the whole tree balanced. Takes O(n + k) without descents
+  template <typename InputIt>
+  void merge_sorted(InputIt first, InputIt last) noexcept {
+    node_t* existing = nullptr;
+    node_t* removed = nullptr;
+    std::size_t count =
+        flatten(existing, removed, [](const T&) { return false; });
+
+    node_t* head = nullptr;
+    node_t** tail = &head;
+    while (existing || first != last) {
+      node_t* next;
+      if (first == last ||
+          (existing && less(get_key(existing), Getter::get(**first)))) {
+        next = existing;
+        existing = existing->left;
+      } else {
+        next = static_cast<node_t*>(*first++);
+        count++;
       }
+      *tail = next;
+      tail = &next->left;
     }
-    sentinel->left = add_to_tree(obj, sentinel->left);
-    sentinel->left->parent = sentinel;
-    return iterator(&obj);
+    *tail = nullptr;
+    set_root(build(count, head));
+  }
+
+  // Unlinks every node matching pred, rebuilds the rest balanced and then
+  // passes the unlinked nodes to dispose. Takes O(n) without descents
+  template <typename Pred, typename Disposer>
+  void erase_if(Pred pred, Disposer dispose) {
+    node_t* kept = nullptr;
+    node_t* removed = nullptr;
+    std::size_t count = flatten(kept, removed, pred);
+    set_root(build(count, kept));
+    while (removed) {
+      node_t* node = removed;
+      removed = removed->left;
+      node->left = node->right = node->parent = nullptr;
+      dispose(*static_cast<T*>(node));
+    }
+  }
+
+  // Detaches [first, last) with two splits and a join in O(height), then
+  // unlinks its nodes and passes them to dispose in order
+  template <typename Disposer>
+  void erase(iterator first, iterator last, Disposer dispose) noexcept {
+    if (first == last) {
+      return;
+    }
+    auto [lesser, range] = split(sentinel->left, get_key(first.node));
+    node_t* greater = nullptr;
+    if (last != end()) {
+      std::tie(range, greater) = split(range, get_key(last.node));
+    }
+    set_root(join(lesser, greater));
+
+    // rotates left children up, so the walk needs neither stack nor parents
+    while (range) {
+      if (range->left) {
+        node_t* left = range->left;
+        range->left = left->right;
+        left->right = range;
+        range = left;
+      } else {
+        node_t* node = range;
+        range = range->right;
+        node->left = node->right = node->parent = nullptr;
+        dispose(*static_cast<T*>(node));
+      }
+    }
+  }
+
+  // Empties the set without touching the nodes, which keep stale links. Only
+  // for nodes that are about to be destroyed or relinked from scratch
+  void clear() noexcept {
+    sentinel->left = nullptr;
   }
 
   T* erase(iterator it) noexcept {
@@ -229,22 +474,174 @@ public:
   }
 
   iterator lower_bound(const Key& key) const noexcept {
-    return iterator(bound_impl(key, sentinel->left));
+    return lower_bound_impl(key);
+  }
+
+  template <typename K>
+    requires details::transparent<Compare>
+  iterator lower_bound(const K& key) const noexcept {
+    return lower_bound_impl(key);
   }
 
   iterator upper_bound(const Key& key) const noexcept {
-    auto it = lower_bound(key);
-    if (it != end() && equals(key, get_key(it.node))) {
-      ++it;
-    }
-    return it;
+    return upper_bound_impl(key);
+  }
+
+  template <typename K>
+    requires details::transparent<Compare>
+  iterator upper_bound(const K& key) const noexcept {
+    return upper_bound_impl(key);
   }
 
   iterator find(const Key& key) const noexcept {
-    auto it = lower_bound(key);
-    // need compare cause cast (get_key) sentinel is UB. In bimap sentinel
-    // doesn't have key field
-    return it != end() && equals(key, get_key(it.node)) ? it : end();
+    return find_impl(key);
+  }
+
+  template <typename K>
+    requires details::transparent<Compare>
+  iterator find(const K& key) const noexcept {
+    return find_impl(key);
+  }
+
+  // Finds every key and calls out(index, iterator). Descents of a group of
+  // keys advance in lockstep and prefetch each next node before the other
+  // keys are compared, so their cache misses overlap instead of queueing up
+  template <typename K, typename Out>
+  void find_batch(const K* keys, std::size_t count, Out out) const {
+    constexpr std::size_t group = 16;
+    node_t* nodes[group];
+    node_t* candidates[group];
+    for (std::size_t first = 0; first < count; first += group) {
+      std::size_t size = std::min(group, count - first);
+      const K* group_keys = keys + first;
+      for (std::size_t i = 0; i < size; i++) {
+        nodes[i] = sentinel->left;
+        candidates[i] = sentinel;
+      }
+      for (bool active = sentinel->left; active;) {
+        active = false;
+        for (std::size_t i = 0; i < size; i++) {
+          if (!nodes[i]) {
+            continue;
+          }
+          step_find(nodes[i], candidates[i], group_keys[i]);
+          if (nodes[i]) {
+            details::prefetch(nodes[i]);
+            details::prefetch(&get_key(nodes[i]));
+            active = true;
+          }
+        }
+      }
+      for (std::size_t i = 0; i < size; i++) {
+        out(first + i, iterator(found(candidates[i], group_keys[i])));
+      }
+    }
+  }
+
+  // lower_bound of a key not less than the key finger is the lower_bound of.
+  // Climbs from finger through parent links only until the subtree must hold
+  // the answer, so close keys cost O(log distance) instead of O(height)
+  template <typename K>
+  iterator lower_bound_from(iterator finger, const K& key) const noexcept {
+    node_t* node = finger.node;
+    if (node == sentinel) {
+      return end();
+    }
+    node_t* bound = sentinel;
+    while (node->parent != sentinel) {
+      node_t* parent = node->parent;
+      if (parent->left == node && !less(get_key(parent), key)) {
+        bound = parent;
+        break;
+      }
+      node = parent;
+    }
+    node_t* result = bound;
+    while (node) {
+      if (less(get_key(node), key)) {
+        node = node->right;
+      } else {
+        result = node;
+        node = node->left;
+      }
+    }
+    return iterator(result);
+  }
+
+  // Finds keys sorted in ascending order and calls out(index, iterator),
+  // searching each one from the previous hit with lower_bound_from
+  template <typename K, typename Out>
+  void find_sorted(const K* keys, std::size_t count, Out out) const {
+    iterator finger = end();
+    for (std::size_t i = 0; i < count; i++) {
+      finger = i == 0 ? lower_bound_impl(keys[i])
+                      : lower_bound_from(finger, keys[i]);
+      out(i, iterator(found(finger.node, keys[i])));
+    }
+  }
+
+  // lower_bound that starts at finger, the result of an earlier search, and
+  // moves finger to the new result. Keys above finger take a lower_bound_from,
+  // keys down to its predecessor a comparison or two and keys below that a
+  // descent from the root. A null finger or end() means no earlier result
+  template <typename K>
+  iterator lower_bound_near(iterator& finger, const K& key) const noexcept {
+    node_t* node = finger.node;
+    iterator result;
+    if (!node || node == sentinel) {
+      result = lower_bound_impl(key);
+    } else if (less(get_key(node), key)) {
+      result = lower_bound_from(finger, key);
+    } else if (!less(key, get_key(node))) {
+      result = finger;
+    } else {
+      node_t* prev = std::prev(finger).node;
+      result = !prev || less(get_key(prev), key) ? finger
+                                                 : lower_bound_impl(key);
+    }
+    if (result != end()) {
+      finger = result;
+    }
+    return result;
+  }
+
+  template <typename K>
+  iterator find_near(iterator& finger, const K& key) const noexcept {
+    iterator result = lower_bound_near(finger, key);
+    return result != end() && !less(key, get_key(result.node)) ? result
+                                                               : end();
+  }
+
+  // The descent of find one level per step(), for lookups that interleave
+  // descents, such as coro::async_find. next() is the node the next step
+  // reads, null once result() is known. key must outlive the descent
+  template <typename K>
+  struct stepwise_find {
+    const intrusive_set* set;
+    node_t* node;
+    node_t* candidate;
+    const K* key;
+
+    const void* next() const noexcept {
+      return node;
+    }
+
+    const void* next_key() const noexcept {
+      return &set->get_key(node);
+    }
+
+    void step() noexcept {
+      set->step_find(node, candidate, *key);
+    }
+
+    iterator result() const noexcept {
+      return iterator(set->found(candidate, *key));
+    }
+  };
+
+  template <typename K>
+  stepwise_find<K> find_stepwise(const K& key) const noexcept {
+    return {this, sentinel->left, sentinel, &key};
   }
 
   iterator begin() const noexcept {
@@ -260,36 +657,200 @@ public:
   }
 
 private:
-  node_t* bound_impl(const Key& key, node_t* node) const noexcept {
-    if (!node) {
-      return sentinel;
+  // Descents make one comparison per node: they never stop at an equal key
+  // and the last node that went left is the answer
+  template <typename K>
+  iterator lower_bound_impl(const K& key) const noexcept {
+    node_t* result = sentinel;
+    auto&& q = probe(key);
+    for (node_t* node = sentinel->left; node;) {
+      if (node_less(node, q)) {
+        node = node->right;
+      } else {
+        result = node;
+        node = node->left;
+      }
     }
+    return iterator(result);
+  }
 
-    if (less(get_key(node), key)) {
-      return bound_impl(key, node->right);
+  template <typename K>
+  iterator upper_bound_impl(const K& key) const noexcept {
+    node_t* result = sentinel;
+    auto&& q = probe(key);
+    for (node_t* node = sentinel->left; node;) {
+      if (less_node(q, node)) {
+        result = node;
+        node = node->left;
+      } else {
+        node = node->right;
+      }
     }
+    return iterator(result);
+  }
 
-    if (greater(get_key(node), key)) {
-      auto tmp = bound_impl(key, node->left);
-      if (tmp != sentinel) {
-        return tmp;
+  // One level of the find descent: moves node down and remembers in candidate
+  // the node the key may be equal to. Three-way comparators stop at equality,
+  // projections decide unless they tie
+  template <typename K>
+  void step_find(node_t*& node, node_t*& candidate,
+                 const K& key) const noexcept {
+    if constexpr (details::is_projected<K>) {
+      const auto& projection = get_projection(node);
+      if (projection < key.projection) {
+        node = node->right;
+      } else if (key.projection < projection) {
+        candidate = node;
+        node = node->left;
+      } else {
+        step_find(node, candidate, key.key);
+      }
+    } else if constexpr (details::three_way<Compare, Key, K>) {
+      auto order = Compare::operator()(get_key(node), key);
+      if (order < 0) {
+        node = node->right;
+      } else if (order > 0) {
+        node = node->left;
+      } else {
+        candidate = node;
+        node = nullptr;
       }
+    } else if (less(get_key(node), key)) {
+      node = node->right;
+    } else {
+      candidate = node;
+      node = node->left;
     }
-    return node;
   }
 
-  node_t* add_to_tree(T& obj, node_t* node) noexcept {
-    if (!node) {
-      return static_cast<node_t*>(&obj);
-    }
-    if (less(Getter::get(obj), get_key(node))) {
-      node->left = add_to_tree(obj, node->left);
-      node->left->parent = node;
+  template <typename K>
+  node_t* found(node_t* candidate, const K& key) const noexcept {
+    if constexpr (details::is_projected<K>) {
+      // candidates of projection steps are only known not to be less
+      return candidate != sentinel && !less_node(key, candidate) ? candidate
+                                                                 : sentinel;
+    } else if constexpr (details::three_way<Compare, Key, K>) {
+      return candidate;
     } else {
-      node->right = add_to_tree(obj, node->right);
-      node->right->parent = node;
+      // need compare cause cast (get_key) sentinel is UB. In bimap sentinel
+      // doesn't have key field. !(candidate < key) is known, so one call is
+      // enough
+      return candidate != sentinel && !less(key, get_key(candidate))
+                 ? candidate
+                 : sentinel;
+    }
+  }
+
+  template <typename K>
+  iterator find_impl(const K& key) const noexcept {
+    node_t* node = sentinel->left;
+    node_t* candidate = sentinel;
+    auto&& q = probe(key);
+    while (node) {
+      step_find(node, candidate, q);
+    }
+    return iterator(found(candidate, q));
+  }
+
+  void set_root(node_t* root) noexcept {
+    sentinel->left = root;
+    if (root) {
+      root->parent = sentinel;
+    }
+  }
+
+  // Threads the nodes in order through their left links, starting at kept.
+  // Nodes matching pred are threaded the same way into removed, keeping stale
+  // parent and right links. Returns the number of kept nodes
+  template <typename Pred>
+  std::size_t flatten(node_t*& kept, node_t*& removed, Pred pred) {
+    std::size_t count = 0;
+    node_t** tail = &kept;
+    // left links of visited nodes are never read by ++ again
+    for (auto it = begin(); it != end();) {
+      node_t* node = it.node;
+      ++it;
+      if (pred(*static_cast<T*>(node))) {
+        node->left = removed;
+        removed = node;
+      } else {
+        *tail = node;
+        tail = &node->left;
+        count++;
+      }
+    }
+    *tail = nullptr;
+    return count;
+  }
+
+  // Splits the subtree into nodes less than key and the rest, top-down
+  std::pair<node_t*, node_t*> split(node_t* node,
+                                    const Key& key) const noexcept {
+    node_t* lesser = nullptr;
+    node_t* rest = nullptr;
+    node_t** lesser_tail = &lesser;
+    node_t** rest_tail = &rest;
+    node_t* lesser_parent = nullptr;
+    node_t* rest_parent = nullptr;
+    while (node) {
+      if (less(get_key(node), key)) {
+        *lesser_tail = node;
+        node->parent = lesser_parent;
+        lesser_parent = node;
+        lesser_tail = &node->right;
+        node = node->right;
+      } else {
+        *rest_tail = node;
+        node->parent = rest_parent;
+        rest_parent = node;
+        rest_tail = &node->left;
+        node = node->left;
+      }
+    }
+    *lesser_tail = *rest_tail = nullptr;
+    return {lesser, rest};
+  }
+
+  // Joins two subtrees where all keys of left are less than keys of right
+  static node_t* join(node_t* left, node_t* right) noexcept {
+    if (!left || !right) {
+      return left ? left : right;
+    }
+    node_t* root = left;
+    while (root->right) {
+      root = root->right;
+    }
+    if (root != left) {
+      root->parent->right = root->left;
+      if (root->left) {
+        root->left->parent = root->parent;
+      }
+      root->left = left;
+      left->parent = root;
+    }
+    root->right = right;
+    right->parent = root;
+    return root;
+  }
+
+  // Builds a balanced tree of the first n nodes of the list threaded through
+  // left links and advances head past them. Recursion depth is O(log n)
+  static node_t* build(std::size_t n, node_t*& head) noexcept {
+    if (n == 0) {
+      return nullptr;
+    }
+    node_t* left = build(n / 2, head);
+    node_t* root = head;
+    head = head->left;
+    root->left = left;
+    if (left) {
+      left->parent = root;
+    }
+    root->right = build(n - n / 2 - 1, head);
+    if (root->right) {
+      root->right->parent = root;
     }
-    return node;
+    return root;
   }
 };
 
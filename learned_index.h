@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// Search index over distinct sorted integers that predicts positions with a
+// piecewise linear model of the keys, as PGM and RadixSpline indexes do. Each
+// segment predicts the positions of its keys within Error, so a lookup picks
+// the segment through a radix table on the top bits of the key and a short
+// search, and then searches the 2 * Error + 2 keys around the prediction,
+// which is a cache miss or two. The model takes some KB for smooth keys such
+// as timestamps and sequential ids, but gets a segment per few keys for
+// random ones
+template <typename Key, std::size_t Error = 32>
+struct learned_index {
+  static_assert(std::is_integral_v<Key> && !std::is_same_v<Key, bool>,
+                "the model fits keys as integers");
+
+  learned_index() = default;
+
+  // Index of the sorted distinct keys between first and last
+  template <typename Iterator>
+  learned_index(Iterator first, Iterator last) {
+    if constexpr (std::forward_iterator<Iterator>) {
+      sorted.reserve(static_cast<std::size_t>(std::distance(first, last)));
+    }
+    for (; first != last; ++first) {
+      sorted.push_back(*first);
+    }
+    if (!sorted.empty()) {
+      smallest = sorted.front();
+      fit();
+      build_table();
+    }
+  }
+
+  // Number of keys less than key
+  std::size_t lower_bound(Key key) const noexcept {
+    if (sorted.empty() || key <= smallest) {
+      return 0;
+    }
+    std::size_t count = sorted.size();
+    std::size_t pos = predict(offset(key));
+    std::size_t lo = pos > Error + 1 ? pos - Error - 1 : 0;
+    std::size_t hi = std::min(pos + Error + 2, count);
+    // probes past the last key of a segment can land further off
+    for (std::size_t step = Error + 1; lo > 0 && !(sorted[lo - 1] < key);
+         step *= 2) {
+      lo = lo > step ? lo - step : 0;
+    }
+    for (std::size_t step = Error + 1; hi < count && sorted[hi] < key;
+         step *= 2) {
+      hi = std::min(hi + step, count);
+    }
+    return static_cast<std::size_t>(
+        std::lower_bound(sorted.begin() + static_cast<std::ptrdiff_t>(lo),
+                         sorted.begin() + static_cast<std::ptrdiff_t>(hi),
+                         key) -
+        sorted.begin());
+  }
+
+  // Number of keys not greater than key
+  std::size_t upper_bound(Key key) const noexcept {
+    if (key == std::numeric_limits<Key>::max()) {
+      return sorted.size();
+    }
+    return lower_bound(static_cast<Key>(key + 1));
+  }
+
+  // Position of key, or size() if there is no such key
+  std::size_t find(Key key) const noexcept {
+    std::size_t pos = lower_bound(key);
+    return pos < sorted.size() && sorted[pos] == key ? pos : sorted.size();
+  }
+
+  std::size_t size() const noexcept {
+    return sorted.size();
+  }
+
+  // Bytes of the segments and the radix table, without the keys
+  std::size_t model_bytes() const noexcept {
+    return segments.size() * sizeof(segment) +
+           table.size() * sizeof(std::uint32_t);
+  }
+
+private:
+  using offset_t = std::make_unsigned_t<Key>;
+
+  struct segment {
+    offset_t first;
+    double slope;
+    std::size_t pos;
+  };
+
+  // Keys keep their order as unsigned distances from the smallest one
+  offset_t offset(Key key) const noexcept {
+    return static_cast<offset_t>(static_cast<offset_t>(key) -
+                                 static_cast<offset_t>(smallest));
+  }
+
+  std::size_t predict(offset_t off) const noexcept {
+    std::size_t p = std::min(static_cast<std::size_t>(off >> shift),
+                             table.size() - 2);
+    // the last segment starting at off or before starts in bucket p or is
+    // the one before the bucket's first
+    auto first = segments.begin() + (table[p] == 0 ? 0 : table[p] - 1);
+    auto last = segments.begin() + table[p + 1];
+    auto it = std::upper_bound(first, last, off,
+                               [](offset_t probe, const segment& s) {
+                                 return probe < s.first;
+                               }) -
+              1;
+    auto distance = static_cast<offset_t>(off - it->first);
+    double guess = static_cast<double>(it->pos) +
+                   it->slope * static_cast<double>(distance);
+    if (!(guess > 0)) {
+      return 0;
+    }
+    return std::min(static_cast<std::size_t>(guess), sorted.size());
+  }
+
+  // Greedily extends each segment while some slope through its first key
+  // keeps every key of it within Error of its position
+  void fit() {
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+    std::size_t start = 0;
+    double low = 0, high = infinity;
+    auto close = [&] {
+      segments.push_back({offset(sorted[start]),
+                          high == infinity ? 0 : (low + high) / 2, start});
+    };
+    for (std::size_t i = 1; i < sorted.size(); i++) {
+      auto dx = static_cast<double>(
+          static_cast<offset_t>(offset(sorted[i]) - offset(sorted[start])));
+      auto dy = static_cast<double>(i - start);
+      double new_low = std::max(low, (dy - Error) / dx);
+      double new_high = std::min(high, (dy + Error) / dx);
+      if (new_low > new_high) {
+        close();
+        start = i;
+        low = 0;
+        high = infinity;
+      } else {
+        low = new_low;
+        high = new_high;
+      }
+    }
+    close();
+  }
+
+  // Buckets of the top bits of offsets, about two per segment, each with the
+  // index of its first segment
+  void build_table() {
+    int bits = std::min(static_cast<int>(std::bit_width(segments.size())) + 1,
+                        24);
+    int width = static_cast<int>(std::bit_width(offset(sorted.back())));
+    shift = width > bits ? width - bits : 0;
+    std::size_t buckets = std::size_t(1) << bits;
+    table.resize(buckets + 1);
+    std::size_t s = 0;
+    for (std::size_t p = 0; p <= buckets; p++) {
+      while (s < segments.size() &&
+             static_cast<std::size_t>(segments[s].first >> shift) < p) {
+        s++;
+      }
+      table[p] = static_cast<std::uint32_t>(s);
+    }
+  }
+
+  std::vector<Key> sorted;
+  std::vector<segment> segments;
+  std::vector<std::uint32_t> table;
+  Key smallest = 0;
+  int shift = 0;
+};
@@ -0,0 +1,496 @@
+#pragma once
+
+#include "inline_string.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Minimal perfect hash function over distinct 64-bit hashes, in the style of
+// PTHash: hashes fall into buckets of about four, and each bucket stores the
+// pilot, found at build time, that sends its hashes to slots no other hash
+// takes. Evaluating it is two mixes, a pilot load and a multiply. A bucket
+// tries at most max_pilot pilots. If none fits, the build starts over with
+// the hashes mixed under the next seed, and after max_seeds seeds it throws
+// std::runtime_error. The last buckets look for the few free slots among n,
+// so max_pilot 0 allows 64 pilots per hash, which one of them exceeds with
+// a chance of about e^-64
+struct minimal_perfect_hash {
+  minimal_perfect_hash() = default;
+
+  explicit minimal_perfect_hash(std::span<const std::uint64_t> hashes,
+                                std::uint32_t max_pilot = 0,
+                                std::uint32_t max_seeds = 16)
+      : count(hashes.size()) {
+    if (count > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::length_error("too many keys for a perfect hash");
+    }
+    if (max_pilot == 0) {
+      max_pilot = static_cast<std::uint32_t>(std::min<std::uint64_t>(
+          std::max<std::uint64_t>(64 * std::uint64_t{count}, 1 << 16),
+          std::numeric_limits<std::uint32_t>::max()));
+    }
+    for (; seed < max_seeds; seed++) {
+      if (place_buckets(hashes, max_pilot)) {
+        return;
+      }
+    }
+    throw std::runtime_error("no perfect hash found");
+  }
+
+  // Slot below size() of one of the hashes the function was built for
+  std::size_t operator()(std::uint64_t hash) const noexcept {
+    hash = mix(hash ^ seed_bits());
+    return slot_of(hash, pilots[bucket_of(hash)]);
+  }
+
+  std::size_t size() const noexcept {
+    return count;
+  }
+
+private:
+  // Finds the pilots of all buckets under the current seed, or returns false
+  // if a bucket has no pilot below max_pilot
+  bool place_buckets(std::span<const std::uint64_t> hashes,
+                     std::uint32_t max_pilot) {
+    pilots.assign(std::max<std::size_t>((count + 3) / 4, 1), 0);
+    std::vector<std::uint64_t> mixed(count);
+    std::vector<std::uint32_t> start(pilots.size() + 1), by_bucket(count);
+    for (std::size_t i = 0; i < count; i++) {
+      mixed[i] = mix(hashes[i] ^ seed_bits());
+      start[bucket_of(mixed[i]) + 1]++;
+    }
+    std::partial_sum(start.begin(), start.end(), start.begin());
+    auto next = start;
+    for (std::size_t i = 0; i < count; i++) {
+      by_bucket[next[bucket_of(mixed[i])]++] = static_cast<std::uint32_t>(i);
+    }
+    // large buckets go first, while most slots are free
+    std::vector<std::uint32_t> buckets(pilots.size());
+    std::iota(buckets.begin(), buckets.end(), 0);
+    std::stable_sort(buckets.begin(), buckets.end(),
+                     [&](std::uint32_t a, std::uint32_t b) {
+                       return start[a + 1] - start[a] > start[b + 1] - start[b];
+                     });
+    std::vector<bool> taken(count);
+    std::vector<std::size_t> slots;
+    for (std::uint32_t bucket : buckets) {
+      std::uint32_t pilot = 0;
+      for (; pilot < max_pilot; pilot++) {
+        slots.clear();
+        for (std::size_t i = start[bucket]; i < start[bucket + 1]; i++) {
+          std::size_t slot = slot_of(mixed[by_bucket[i]], pilot);
+          if (taken[slot] ||
+              std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+            break;
+          }
+          slots.push_back(slot);
+        }
+        if (slots.size() == start[bucket + 1] - start[bucket]) {
+          for (std::size_t slot : slots) {
+            taken[slot] = true;
+          }
+          pilots[bucket] = pilot;
+          break;
+        }
+      }
+      if (pilot == max_pilot) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Xoring a constant keeps distinct hashes distinct
+  std::uint64_t seed_bits() const noexcept {
+    return seed * 0xd6e8feb86659fd93ull;
+  }
+
+  // std::hash is the identity for integers, so its bits are mixed first
+  static std::uint64_t mix(std::uint64_t hash) noexcept {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    return hash ^ (hash >> 33);
+  }
+
+  // Buckets come from the low half of the mixed hash and slots from the
+  // high half, each scaled by a multiply rather than a division
+  std::size_t bucket_of(std::uint64_t hash) const noexcept {
+    return static_cast<std::size_t>(((hash & 0xffffffffu) * pilots.size()) >>
+                                    32);
+  }
+
+  std::size_t slot_of(std::uint64_t hash, std::uint32_t pilot) const noexcept {
+    // a full mix, as two hashes that only differ in bits below what the
+    // multiply keeps would get the same slot whatever was xored into them
+    std::uint64_t moved = mix(hash ^ (pilot * 0x9E3779B97F4A7C15ull));
+    return static_cast<std::size_t>(((moved >> 32) * count) >> 32);
+  }
+
+  std::vector<std::uint32_t> pilots;
+  std::size_t count = 0;
+  std::uint64_t seed = 0;
+};
+
+// Bimap of a fixed set of pairs with a minimal perfect hash per side. The
+// pairs are in one array in the slots of the left function, and the right
+// function's slots map to them, so a lookup is a hash, a pilot load and a
+// key compare next to the other key, plus the map load on the right side.
+// Iterators walk the pairs in slot order on both sides and flip() keeps the
+// slot. Building throws std::invalid_argument for duplicate keys, and for
+// distinct keys of a side with equal hashes, which no perfect hash can tell
+// apart. The map keeps copies of the characters of inline_string keys, as
+// bimap does
+template <typename Left, typename Right, typename HashLeft = std::hash<Left>,
+          typename HashRight = std::hash<Right>,
+          typename EqualLeft = std::equal_to<Left>,
+          typename EqualRight = std::equal_to<Right>>
+struct perfect_hash_bimap {
+private:
+  using left_t = Left;
+  using right_t = Right;
+
+  static constexpr bool inline_keys =
+      std::is_same_v<Left, inline_string> ||
+      std::is_same_v<Right, inline_string>;
+
+  struct no_store {};
+
+  template <typename T>
+  struct template_iterator;
+
+  struct right_struct;
+
+  struct left_struct {
+    using key = left_t;
+    using hash = HashLeft;
+    using equal = EqualLeft;
+    using iterator = template_iterator<left_struct>;
+    using flip_struct = right_struct;
+  };
+
+  struct right_struct {
+    using key = right_t;
+    using hash = HashRight;
+    using equal = EqualRight;
+    using iterator = template_iterator<right_struct>;
+    using flip_struct = left_struct;
+  };
+
+  template <typename Traits>
+  struct template_iterator {
+  private:
+    friend struct perfect_hash_bimap;
+
+    template <typename U>
+    friend struct template_iterator;
+
+    const perfect_hash_bimap* map = nullptr;
+    std::size_t slot = 0;
+
+    template_iterator(const perfect_hash_bimap* map_,
+                      std::size_t slot_) noexcept
+        : map(map_), slot(slot_) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename Traits::key;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    template_iterator() = default;
+
+    reference operator*() const noexcept {
+      return map->key_of<Traits>(slot);
+    }
+
+    pointer operator->() const noexcept {
+      return &operator*();
+    }
+
+    template_iterator& operator++() noexcept {
+      slot++;
+      return *this;
+    }
+
+    template_iterator operator++(int) noexcept {
+      auto tmp = *this;
+      slot++;
+      return tmp;
+    }
+
+    template_iterator& operator--() noexcept {
+      slot--;
+      return *this;
+    }
+
+    template_iterator operator--(int) noexcept {
+      auto tmp = *this;
+      slot--;
+      return tmp;
+    }
+
+    typename Traits::flip_struct::iterator flip() const noexcept {
+      return {map, slot};
+    }
+
+    friend bool operator==(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.slot == right.slot;
+    }
+
+    friend bool operator!=(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.slot != right.slot;
+    }
+  };
+
+public:
+  using left_iterator = typename left_struct::iterator;
+
+  using right_iterator = typename right_struct::iterator;
+
+  perfect_hash_bimap(HashLeft hash_left = HashLeft(),
+                     HashRight hash_right = HashRight(),
+                     EqualLeft equal_left = EqualLeft(),
+                     EqualRight equal_right = EqualRight())
+      : left_hash(std::move(hash_left)), right_hash(std::move(hash_right)),
+        left_equal(std::move(equal_left)),
+        right_equal(std::move(equal_right)) {}
+
+  // Builds the map of the pairs
+  explicit perfect_hash_bimap(
+      std::span<const std::pair<left_t, right_t>> pairs,
+      HashLeft hash_left = HashLeft(), HashRight hash_right = HashRight(),
+      EqualLeft equal_left = EqualLeft(), EqualRight equal_right = EqualRight())
+      : perfect_hash_bimap(std::move(hash_left), std::move(hash_right),
+                           std::move(equal_left), std::move(equal_right)) {
+    build(pairs);
+  }
+
+  // Builds the map of the pairs between left iterators first and last of a
+  // map
+  template <typename LeftIterator>
+  perfect_hash_bimap(LeftIterator first, LeftIterator last,
+                     HashLeft hash_left = HashLeft(),
+                     HashRight hash_right = HashRight(),
+                     EqualLeft equal_left = EqualLeft(),
+                     EqualRight equal_right = EqualRight())
+      : perfect_hash_bimap(std::move(hash_left), std::move(hash_right),
+                           std::move(equal_left), std::move(equal_right)) {
+    std::vector<std::pair<left_t, right_t>> pairs;
+    for (; first != last; ++first) {
+      pairs.emplace_back(*first, *first.flip());
+    }
+    build(pairs);
+  }
+
+  void swap(perfect_hash_bimap& other) noexcept {
+    using std::swap;
+    swap(left_hash, other.left_hash);
+    swap(right_hash, other.right_hash);
+    swap(left_equal, other.left_equal);
+    swap(right_equal, other.right_equal);
+    swap(left_function, other.left_function);
+    swap(right_function, other.right_function);
+    pairs.swap(other.pairs);
+    right_slots.swap(other.right_slots);
+    swap(chars, other.chars);
+  }
+
+  left_iterator find_left(const left_t& left) const noexcept {
+    return find<left_struct>(left);
+  }
+
+  right_iterator find_right(const right_t& right) const noexcept {
+    return find<right_struct>(right);
+  }
+
+  right_t const& at_left(const left_t& key) const {
+    return at_key<left_struct>(key);
+  }
+
+  left_t const& at_right(const right_t& key) const {
+    return at_key<right_struct>(key);
+  }
+
+  left_iterator begin_left() const noexcept {
+    return {this, 0};
+  }
+
+  left_iterator end_left() const noexcept {
+    return {this, size()};
+  }
+
+  right_iterator begin_right() const noexcept {
+    return {this, 0};
+  }
+
+  right_iterator end_right() const noexcept {
+    return {this, size()};
+  }
+
+  bool empty() const noexcept {
+    return pairs.empty();
+  }
+
+  std::size_t size() const noexcept {
+    return pairs.size();
+  }
+
+  // Equal when both hold the same pairs, whatever their slot order
+  friend bool operator==(const perfect_hash_bimap& a,
+                         const perfect_hash_bimap& b) noexcept {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+      auto other = b.find_left(*it);
+      if (other == b.end_left() || !a.right_equal(*it.flip(), *other.flip())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const perfect_hash_bimap& a,
+                         const perfect_hash_bimap& b) noexcept {
+    return !(a == b);
+  }
+
+private:
+  template <typename Traits>
+  const typename Traits::key& key_of(std::size_t slot) const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return pairs[slot].first;
+    } else {
+      return pairs[slot].second;
+    }
+  }
+
+  template <typename Traits>
+  std::uint64_t hash_of(const typename Traits::key& key) const {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return static_cast<std::uint64_t>(left_hash(key));
+    } else {
+      return static_cast<std::uint64_t>(right_hash(key));
+    }
+  }
+
+  template <typename Traits>
+  bool equal(const typename Traits::key& a,
+             const typename Traits::key& b) const {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return left_equal(a, b);
+    } else {
+      return right_equal(a, b);
+    }
+  }
+
+  template <typename Traits>
+  typename Traits::iterator
+  find(const typename Traits::key& key) const noexcept {
+    if (empty()) {
+      return {this, 0};
+    }
+    std::size_t slot;
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      slot = left_function(hash_of<Traits>(key));
+    } else {
+      slot = right_slots[right_function(hash_of<Traits>(key))];
+    }
+    // keys outside the set land on some slot too
+    if (equal<Traits>(key_of<Traits>(slot), key)) {
+      return {this, slot};
+    }
+    return {this, size()};
+  }
+
+  template <typename Traits>
+  const typename Traits::flip_struct::key&
+  at_key(const typename Traits::key& key) const {
+    auto it = find<Traits>(key);
+    if (it.slot == size()) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return *it.flip();
+  }
+
+  // Hashes of a side of the pairs, which have to differ
+  template <typename Traits, typename Proj>
+  std::vector<std::uint64_t> distinct_hashes(std::size_t count,
+                                             Proj proj) const {
+    std::vector<std::uint64_t> hashes(count);
+    std::vector<std::size_t> order(count);
+    for (std::size_t i = 0; i < count; i++) {
+      hashes[i] = hash_of<Traits>(proj(i));
+    }
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+      return hashes[a] < hashes[b];
+    });
+    for (std::size_t i = 1; i < count; i++) {
+      if (hashes[order[i - 1]] == hashes[order[i]]) {
+        throw std::invalid_argument(
+            equal<Traits>(proj(order[i - 1]), proj(order[i]))
+                ? "duplicate keys"
+                : "keys with equal hashes");
+      }
+    }
+    return hashes;
+  }
+
+  void build(std::span<const std::pair<left_t, right_t>> batch) {
+    auto left_hashes = distinct_hashes<left_struct>(
+        batch.size(),
+        [&](std::size_t i) -> const left_t& { return batch[i].first; });
+    auto right_hashes = distinct_hashes<right_struct>(
+        batch.size(),
+        [&](std::size_t i) -> const right_t& { return batch[i].second; });
+    left_function = minimal_perfect_hash(left_hashes);
+    right_function = minimal_perfect_hash(right_hashes);
+    std::vector<std::uint32_t> pair_at(batch.size());
+    right_slots.resize(batch.size());
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      std::size_t slot = left_function(left_hashes[i]);
+      pair_at[slot] = static_cast<std::uint32_t>(i);
+      right_slots[right_function(right_hashes[i])] =
+          static_cast<std::uint32_t>(slot);
+    }
+    pairs.reserve(batch.size());
+    for (std::uint32_t i : pair_at) {
+      pairs.push_back(batch[i]);
+    }
+    if constexpr (inline_keys) {
+      chars.adopt([this](auto visit) {
+        for (auto& [left, right] : pairs) {
+          visit(left);
+          visit(right);
+        }
+      });
+    }
+  }
+
+  [[no_unique_address]] HashLeft left_hash;
+  [[no_unique_address]] HashRight right_hash;
+  [[no_unique_address]] EqualLeft left_equal;
+  [[no_unique_address]] EqualRight right_equal;
+  minimal_perfect_hash left_function;
+  minimal_perfect_hash right_function;
+  std::vector<std::pair<left_t, right_t>> pairs;
+  std::vector<std::uint32_t> right_slots;
+  [[no_unique_address]] std::conditional_t<inline_keys, inline_string_store,
+                                           no_store>
+      chars;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+// Lexicographic order of strings that projects each key to its first Bytes
+// bytes read as a big-endian integer, zero padded. Nodes cache the prefix
+// next to their links, so descents compare integers and follow the key's
+// pointer into its characters only when prefixes tie. Bytes is a multiple
+// of 8; bimap<std::string, std::string, prefix_less<>> for URL-like keys
+template <std::size_t Bytes = 8>
+struct prefix_less {
+  static_assert(Bytes > 0 && Bytes % 8 == 0,
+                "prefix is a whole number of 64-bit words");
+
+  using prefix_t =
+      std::conditional_t<Bytes == 8, std::uint64_t,
+                         std::array<std::uint64_t, Bytes / 8>>;
+
+  bool operator()(std::string_view a, std::string_view b) const noexcept {
+    return a < b;
+  }
+
+  // Orders as the strings do: char_traits<char> compares bytes as unsigned,
+  // and padding with zeros never puts a string after its extensions
+  prefix_t project(std::string_view key) const noexcept {
+    if constexpr (Bytes == 8) {
+      return word(key, 0);
+    } else {
+      prefix_t prefix;
+      for (std::size_t i = 0; i < prefix.size(); i++) {
+        prefix[i] = word(key, i * 8);
+      }
+      return prefix;
+    }
+  }
+
+private:
+  static std::uint64_t word(std::string_view key, std::size_t offset) noexcept {
+    unsigned char bytes[8] = {};
+    if (offset < key.size()) {
+      std::memcpy(bytes, key.data() + offset,
+                  std::min<std::size_t>(8, key.size() - offset));
+    }
+    std::uint64_t result = 0;
+    for (unsigned char byte : bytes) {
+      result = result << 8 | byte;
+    }
+    return result;
+  }
+};
@@ -0,0 +1,627 @@
+#pragma once
+
+#include "bimap.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bimap that keeps up to N pairs inline, without allocating, and moves them
+// into a bimap, allocated only then, once it grows past N. Inline pairs are
+// two arrays of keys in left order plus the permutation of slots in right
+// order and its inverse. Lookups count the
+// keys less than the probe over the whole array, which is branch-free and
+// vectorizes for arithmetic keys. In the inline mode inserts and erases
+// invalidate iterators, like those of a sorted vector, and growing past N
+// invalidates all iterators. Keys whose moves may throw only append inline
+// and grow into the tree for inserts before the last pair
+template <typename Left, typename Right, std::size_t N = 16,
+          typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+struct small_bimap {
+  static_assert(N > 0 && N <= 255, "inline pairs are indexed by a byte");
+
+private:
+  using left_t = Left;
+  using right_t = Right;
+  using large_t = bimap<Left, Right, CompareLeft, CompareRight>;
+  using index_t = std::uint8_t;
+
+  static constexpr bool nothrow_move =
+      std::is_nothrow_move_constructible_v<Left> &&
+      std::is_nothrow_move_constructible_v<Right>;
+
+  // Shifting slots in place moves keys and can't be undone halfway
+  static constexpr bool nothrow_shift =
+      nothrow_move && std::is_nothrow_move_assignable_v<Left> &&
+      std::is_nothrow_move_assignable_v<Right>;
+
+  template <typename T>
+  union slots {
+    slots() noexcept {}
+
+    ~slots() noexcept {}
+
+    T items[N];
+  };
+
+  template <typename T>
+  struct template_iterator;
+
+  struct right_struct;
+
+  struct left_struct {
+    using key = left_t;
+    using compare = CompareLeft;
+    using large_iterator = typename large_t::left_iterator;
+    using iterator = template_iterator<left_struct>;
+    using flip_struct = right_struct;
+  };
+
+  struct right_struct {
+    using key = right_t;
+    using compare = CompareRight;
+    using large_iterator = typename large_t::right_iterator;
+    using iterator = template_iterator<right_struct>;
+    using flip_struct = left_struct;
+  };
+
+  template <typename Traits>
+  struct template_iterator {
+  private:
+    friend struct small_bimap;
+
+    template <typename U>
+    friend struct template_iterator;
+
+    const small_bimap* map = nullptr;
+    // slot for left iterators and rank in right order for right ones
+    std::size_t pos = 0;
+    typename Traits::large_iterator it;
+
+    template_iterator(const small_bimap* map_, std::size_t pos_,
+                      typename Traits::large_iterator it_) noexcept
+        : map(map_), pos(pos_), it(it_) {}
+
+    bool in_tree() const noexcept {
+      return map && map->large;
+    }
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = typename Traits::key;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    template_iterator() = default;
+
+    reference operator*() const noexcept {
+      if (map->large) {
+        return *it;
+      }
+      return map->key_of<Traits>(map->slot_of<Traits>(pos));
+    }
+
+    pointer operator->() const noexcept {
+      return &operator*();
+    }
+
+    template_iterator& operator++() noexcept {
+      if (map->large) {
+        ++it;
+      } else {
+        pos++;
+      }
+      return *this;
+    }
+
+    template_iterator operator++(int) noexcept {
+      auto tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    template_iterator& operator--() noexcept {
+      if (map->large) {
+        --it;
+      } else {
+        pos--;
+      }
+      return *this;
+    }
+
+    template_iterator operator--(int) noexcept {
+      auto tmp = *this;
+      operator--();
+      return tmp;
+    }
+
+    typename Traits::flip_struct::iterator flip() const noexcept {
+      using flip_iterator = typename Traits::flip_struct::iterator;
+      if (map->large) {
+        return flip_iterator(map, 0, it.flip());
+      }
+      if (pos == map->count) {
+        return flip_iterator(map, pos, {});
+      }
+      return flip_iterator(map, map->pos_of<typename Traits::flip_struct>(
+                                    map->slot_of<Traits>(pos)),
+                           {});
+    }
+
+    friend bool operator==(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.in_tree() ? left.it == right.it : left.pos == right.pos;
+    }
+
+    friend bool operator!=(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return !(left == right);
+    }
+  };
+
+public:
+  using left_iterator = typename left_struct::iterator;
+
+  using right_iterator = typename right_struct::iterator;
+
+  small_bimap(CompareLeft compare_left = CompareLeft(),
+              CompareRight compare_right = CompareRight())
+      : left_compare(std::move(compare_left)),
+        right_compare(std::move(compare_right)) {}
+
+  // Delegates first, so that the destructor frees the slots copied before a
+  // copy throws
+  small_bimap(const small_bimap& other)
+      : small_bimap(other.left_compare, other.right_compare) {
+    if (other.large) {
+      large = std::make_unique<large_t>(*other.large);
+    }
+    for (; count < other.count; count++) {
+      construct_slot(count, other.lefts.items[count],
+                     other.rights.items[count]);
+      right_order[count] = other.right_order[count];
+      right_rank[count] = other.right_rank[count];
+    }
+  }
+
+  small_bimap(small_bimap&& other) noexcept(nothrow_move)
+      : left_compare(other.left_compare), right_compare(other.right_compare) {
+    take(other);
+  }
+
+  small_bimap& operator=(const small_bimap& other) {
+    if (&other != this) {
+      small_bimap(other).swap(*this);
+    }
+    return *this;
+  }
+
+  small_bimap& operator=(small_bimap&& other) noexcept(nothrow_move) {
+    if (&other != this) {
+      clear();
+      left_compare = other.left_compare;
+      right_compare = other.right_compare;
+      take(other);
+    }
+    return *this;
+  }
+
+  ~small_bimap() noexcept {
+    destroy_slots();
+  }
+
+  void swap(small_bimap& other) noexcept(nothrow_move) {
+    small_bimap tmp(std::move(other));
+    other = std::move(*this);
+    *this = std::move(tmp);
+  }
+
+  // Whether the pairs have moved to the tree
+  bool is_inline() const noexcept {
+    return !large;
+  }
+
+  left_iterator insert(const left_t& left, const right_t& right) {
+    return perfect_forwarding_insert(left, right);
+  }
+
+  left_iterator insert(const left_t& left, right_t&& right) {
+    return perfect_forwarding_insert(left, std::move(right));
+  }
+
+  left_iterator insert(left_t&& left, const right_t& right) {
+    return perfect_forwarding_insert(std::move(left), right);
+  }
+
+  left_iterator insert(left_t&& left, right_t&& right) {
+    return perfect_forwarding_insert(std::move(left), std::move(right));
+  }
+
+  left_iterator erase_left(left_iterator it) noexcept {
+    if (large) {
+      return left_iterator(this, 0, large->erase_left(it.it));
+    }
+    erase_slot(it.pos);
+    return it;
+  }
+
+  bool erase_left(const left_t& left) noexcept {
+    return erase_key<left_struct>(left);
+  }
+
+  right_iterator erase_right(right_iterator it) noexcept {
+    if (large) {
+      return right_iterator(this, 0, large->erase_right(it.it));
+    }
+    erase_slot(right_order[it.pos]);
+    return it;
+  }
+
+  bool erase_right(const right_t& right) noexcept {
+    return erase_key<right_struct>(right);
+  }
+
+  // Empties the map, which then keeps its pairs inline again
+  void clear() noexcept {
+    large.reset();
+    destroy_slots();
+  }
+
+  left_iterator find_left(const left_t& left) const noexcept {
+    return find<left_struct>(left);
+  }
+
+  right_iterator find_right(const right_t& right) const noexcept {
+    return find<right_struct>(right);
+  }
+
+  right_t const& at_left(const left_t& key) const {
+    return at_key<left_struct>(key);
+  }
+
+  left_t const& at_right(const right_t& key) const {
+    return at_key<right_struct>(key);
+  }
+
+  left_iterator lower_bound_left(const left_t& left) const noexcept {
+    if (large) {
+      return left_iterator(this, 0, large->lower_bound_left(left));
+    }
+    return left_iterator(this, rank<left_struct>(left, false), {});
+  }
+
+  left_iterator upper_bound_left(const left_t& left) const noexcept {
+    if (large) {
+      return left_iterator(this, 0, large->upper_bound_left(left));
+    }
+    return left_iterator(this, rank<left_struct>(left, true), {});
+  }
+
+  right_iterator lower_bound_right(const right_t& right) const noexcept {
+    if (large) {
+      return right_iterator(this, 0, large->lower_bound_right(right));
+    }
+    return right_iterator(this, rank<right_struct>(right, false), {});
+  }
+
+  right_iterator upper_bound_right(const right_t& right) const noexcept {
+    if (large) {
+      return right_iterator(this, 0, large->upper_bound_right(right));
+    }
+    return right_iterator(this, rank<right_struct>(right, true), {});
+  }
+
+  left_iterator begin_left() const noexcept {
+    if (large) {
+      return left_iterator(this, 0, large->begin_left());
+    }
+    return left_iterator(this, 0, {});
+  }
+
+  left_iterator end_left() const noexcept {
+    if (large) {
+      return left_iterator(this, 0, large->end_left());
+    }
+    return left_iterator(this, count, {});
+  }
+
+  right_iterator begin_right() const noexcept {
+    if (large) {
+      return right_iterator(this, 0, large->begin_right());
+    }
+    return right_iterator(this, 0, {});
+  }
+
+  right_iterator end_right() const noexcept {
+    if (large) {
+      return right_iterator(this, 0, large->end_right());
+    }
+    return right_iterator(this, count, {});
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  std::size_t size() const noexcept {
+    return large ? large->size() : count;
+  }
+
+  friend bool operator==(const small_bimap& a, const small_bimap& b) noexcept {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+      auto other = b.find_left(*it);
+      if (other == b.end_left() ||
+          !b.template equivalent<right_struct>(*other.flip(), *it.flip())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const small_bimap& a, const small_bimap& b) noexcept {
+    return !(a == b);
+  }
+
+private:
+  template <typename Traits>
+  const typename Traits::compare& compare_of() const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return left_compare;
+    } else {
+      return right_compare;
+    }
+  }
+
+  template <typename Traits, typename L, typename R>
+  bool less(const L& left, const R& right) const noexcept {
+    return intrusive::details::compare_less(compare_of<Traits>(), left,
+                                            right);
+  }
+
+  template <typename Traits>
+  bool equivalent(const typename Traits::key& a,
+                  const typename Traits::key& b) const noexcept {
+    return !less<Traits>(a, b) && !less<Traits>(b, a);
+  }
+
+  template <typename Traits>
+  const typename Traits::key& key_of(std::size_t slot) const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return lefts.items[slot];
+    } else {
+      return rights.items[slot];
+    }
+  }
+
+  // Slot at position pos of the Traits order and back
+  template <typename Traits>
+  std::size_t slot_of(std::size_t pos) const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return pos;
+    } else {
+      return right_order[pos];
+    }
+  }
+
+  template <typename Traits>
+  std::size_t pos_of(std::size_t slot) const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return slot;
+    } else {
+      return right_rank[slot];
+    }
+  }
+
+  template <typename Traits>
+  typename Traits::iterator end_of() const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return end_left();
+    } else {
+      return end_right();
+    }
+  }
+
+  // Number of inline keys less than key, or not greater with upper. The
+  // keys of a side are distinct, so that is the position of key in the
+  // side's order, whichever order the slots are in
+  template <typename Traits>
+  std::size_t rank(const typename Traits::key& key,
+                   bool upper) const noexcept {
+    std::size_t result = 0;
+    for (std::size_t slot = 0; slot < count; slot++) {
+      result += upper ? !less<Traits>(key, key_of<Traits>(slot))
+                      : less<Traits>(key_of<Traits>(slot), key);
+    }
+    return result;
+  }
+
+  template <typename Traits>
+  typename Traits::iterator find(const typename Traits::key& key) const {
+    using iterator = typename Traits::iterator;
+    if (large) {
+      if constexpr (std::is_same_v<Traits, left_struct>) {
+        return iterator(this, 0, large->find_left(key));
+      } else {
+        return iterator(this, 0, large->find_right(key));
+      }
+    }
+    std::size_t pos = rank<Traits>(key, false);
+    if (pos < count &&
+        !less<Traits>(key, key_of<Traits>(slot_of<Traits>(pos)))) {
+      return iterator(this, pos, {});
+    }
+    return end_of<Traits>();
+  }
+
+  template <typename Traits>
+  bool erase_key(const typename Traits::key& key) noexcept {
+    auto it = find<Traits>(key);
+    if (it == end_of<Traits>()) {
+      return false;
+    }
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      erase_left(it);
+    } else {
+      erase_right(it);
+    }
+    return true;
+  }
+
+  template <typename Traits>
+  const typename Traits::flip_struct::key&
+  at_key(const typename Traits::key& key) const {
+    auto it = find<Traits>(key);
+    if (it == end_of<Traits>()) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return *it.flip();
+  }
+
+  template <typename L, typename R>
+  left_iterator perfect_forwarding_insert(L&& left, R&& right) {
+    if (!large && count == N) {
+      if (find_left(left) != end_left() || find_right(right) != end_right()) {
+        return end_left();
+      }
+      grow();
+    }
+    if (large) {
+      return left_iterator(this, 0,
+                           large->insert(std::forward<L>(left),
+                                         std::forward<R>(right)));
+    }
+    std::size_t slot = rank<left_struct>(left, false);
+    std::size_t order = rank<right_struct>(right, false);
+    if ((slot < count && !less<left_struct>(left, lefts.items[slot])) ||
+        (order < count &&
+         !less<right_struct>(right, rights.items[right_order[order]]))) {
+      return end_left();
+    }
+    if constexpr (!nothrow_shift) {
+      // grow() copies the pairs, so the map stays as it was if that throws
+      if (slot != count) {
+        grow();
+        return left_iterator(this, 0,
+                             large->insert(std::forward<L>(left),
+                                           std::forward<R>(right)));
+      }
+    }
+    insert_slot(slot, order, std::forward<L>(left), std::forward<R>(right));
+    return left_iterator(this, slot, {});
+  }
+
+  template <typename L, typename R>
+  void construct_slot(std::size_t slot, L&& left, R&& right) {
+    std::construct_at(&lefts.items[slot], std::forward<L>(left));
+    try {
+      std::construct_at(&rights.items[slot], std::forward<R>(right));
+    } catch (...) {
+      std::destroy_at(&lefts.items[slot]);
+      throw;
+    }
+  }
+
+  // Shifts the slots from slot on one up to make room for the new pair at
+  // slot, whose right key is order-th in right order
+  template <typename L, typename R>
+  void insert_slot(std::size_t slot, std::size_t order, L&& left, R&& right) {
+    if (slot == count) {
+      construct_slot(count, std::forward<L>(left), std::forward<R>(right));
+    } else {
+      left_t new_left(std::forward<L>(left));
+      right_t new_right(std::forward<R>(right));
+      construct_slot(count, std::move(lefts.items[count - 1]),
+                     std::move(rights.items[count - 1]));
+      std::move_backward(lefts.items + slot, lefts.items + count - 1,
+                         lefts.items + count);
+      std::move_backward(rights.items + slot, rights.items + count - 1,
+                         rights.items + count);
+      lefts.items[slot] = std::move(new_left);
+      rights.items[slot] = std::move(new_right);
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      right_order[i] += right_order[i] >= slot;
+    }
+    std::move_backward(right_order + order, right_order + count,
+                       right_order + count + 1);
+    right_order[order] = static_cast<index_t>(slot);
+    count++;
+    rank_slots();
+  }
+
+  void erase_slot(std::size_t slot) noexcept {
+    std::size_t order = right_rank[slot];
+    std::move(right_order + order + 1, right_order + count,
+              right_order + order);
+    std::move(lefts.items + slot + 1, lefts.items + count, lefts.items + slot);
+    std::move(rights.items + slot + 1, rights.items + count,
+              rights.items + slot);
+    count--;
+    std::destroy_at(&lefts.items[count]);
+    std::destroy_at(&rights.items[count]);
+    for (std::size_t i = 0; i < count; i++) {
+      right_order[i] -= right_order[i] > slot;
+    }
+    rank_slots();
+  }
+
+  // Inverts right_order into right_rank
+  void rank_slots() noexcept {
+    for (std::size_t pos = 0; pos < count; pos++) {
+      right_rank[right_order[pos]] = static_cast<index_t>(pos);
+    }
+  }
+
+  // Moves the pairs of other, which is left empty, into this empty map
+  void take(small_bimap& other) noexcept(nothrow_move) {
+    large = std::move(other.large);
+    for (; count < other.count; count++) {
+      construct_slot(count, std::move(other.lefts.items[count]),
+                     std::move(other.rights.items[count]));
+      right_order[count] = other.right_order[count];
+      right_rank[count] = other.right_rank[count];
+    }
+    other.clear();
+  }
+
+  void destroy_slots() noexcept {
+    std::destroy(lefts.items, lefts.items + count);
+    std::destroy(rights.items, rights.items + count);
+    count = 0;
+  }
+
+  // Moves the inline pairs into a new tree, which links them balanced. They
+  // are copied, so that the map stays as it was if that throws
+  void grow() {
+    std::vector<std::pair<left_t, right_t>> pairs;
+    pairs.reserve(count);
+    for (std::size_t slot = 0; slot < count; slot++) {
+      pairs.emplace_back(lefts.items[slot], rights.items[slot]);
+    }
+    auto tree = std::make_unique<large_t>(left_compare, right_compare);
+    tree->insert_batch(pairs);
+    destroy_slots();
+    large = std::move(tree);
+  }
+
+  [[no_unique_address]] CompareLeft left_compare;
+  [[no_unique_address]] CompareRight right_compare;
+  // the tree once the pairs have outgrown the slots
+  std::unique_ptr<large_t> large;
+  index_t count = 0;
+  index_t right_order[N];
+  index_t right_rank[N];
+  slots<left_t> lefts;
+  slots<right_t> rights;
+};
@@ -0,0 +1,524 @@
+#pragma once
+
+#include "intrusive_set.h"
+#include <bit>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Bimap of at most N pairs that never allocates: its nodes live in an array
+// inside the object, unused ones on an intrusive free list, and the same
+// intrusive trees as in bimap link them. insert returns end_left() when the
+// map is full as it does for taken keys; full() tells them apart. at_left and
+// at_right throw for missing keys, so code that must not allocate uses find.
+// Nodes never move, so iterators stay valid until their pair is erased
+template <typename Left, typename Right, std::size_t N,
+          typename CompareLeft = std::less<Left>,
+          typename CompareRight = std::less<Right>>
+struct static_bimap {
+  static_assert(N > 0, "capacity must be positive");
+
+private:
+  using left_t = Left;
+  using right_t = Right;
+  struct tag_for_left;
+  struct tag_for_right;
+
+  template <typename T>
+  struct template_iterator;
+
+  struct storage_node;
+
+  struct right_struct;
+
+  struct left_struct {
+  public:
+    struct getter {
+      static const left_t& get(const storage_node& storage_node) noexcept {
+        return storage_node.left_key;
+      }
+    };
+    using key = left_t;
+    using base_node = intrusive::node<tag_for_left>;
+    using set = intrusive::intrusive_set<storage_node, key, tag_for_left,
+                                         CompareLeft, getter>;
+    using iterator = template_iterator<left_struct>;
+    using flip_struct = right_struct;
+  };
+
+  struct right_struct {
+  public:
+    struct getter {
+      static const right_t& get(const storage_node& storage_node) noexcept {
+        return storage_node.right_key;
+      }
+    };
+    using key = right_t;
+    using base_node = intrusive::node<tag_for_right>;
+    using set = intrusive::intrusive_set<storage_node, key, tag_for_right,
+                                         CompareRight, getter>;
+    using iterator = template_iterator<right_struct>;
+    using flip_struct = left_struct;
+  };
+
+  struct bimap_based_node : left_struct::base_node, right_struct::base_node {};
+
+  struct storage_node : bimap_based_node {
+  public:
+    typename left_struct::key left_key;
+    typename right_struct::key right_key;
+
+    template <typename L, typename R>
+    storage_node(L&& l, R&& r)
+        : left_key(std::forward<L>(l)), right_key(std::forward<R>(r)) {}
+  };
+
+  // A node in use or a link of the free list
+  union slot {
+    slot() noexcept {}
+
+    ~slot() noexcept {}
+
+    storage_node node;
+    slot* next_free;
+  };
+
+  template <class Traits>
+  struct template_iterator {
+  private:
+    friend struct static_bimap;
+    using intr_set_it = typename Traits::set::iterator;
+    intr_set_it it;
+
+    template <typename U>
+    friend struct template_iterator;
+
+    explicit template_iterator(intr_set_it it_) noexcept : it(it_) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using getter = typename Traits::getter;
+    using value_type = typename Traits::key;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    template_iterator() = default;
+
+    reference operator*() const noexcept {
+      return getter::get(static_cast<storage_node&>(*it));
+    }
+
+    pointer operator->() const noexcept {
+      return &operator*();
+    }
+
+    template_iterator& operator++() noexcept {
+      ++it;
+      return *this;
+    }
+
+    template_iterator operator++(int) noexcept {
+      auto tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    template_iterator& operator--() noexcept {
+      --it;
+      return *this;
+    }
+
+    template_iterator operator--(int) noexcept {
+      auto tmp = *this;
+      operator--();
+      return tmp;
+    }
+
+    typename Traits::flip_struct::iterator flip() const noexcept {
+      auto* based = static_cast<bimap_based_node*>(&*it);
+      typename Traits::flip_struct::set::iterator flipped(
+          static_cast<typename Traits::flip_struct::base_node*>(based));
+      return template_iterator<typename Traits::flip_struct>(flipped);
+    }
+
+    friend bool operator==(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.it == right.it;
+    }
+
+    friend bool operator!=(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.it != right.it;
+    }
+  };
+
+public:
+  using left_iterator = typename left_struct::iterator;
+
+  using right_iterator = typename right_struct::iterator;
+
+  static_bimap(CompareLeft compare_left = CompareLeft(),
+               CompareRight compare_right = CompareRight())
+      : left_set(sentinel, std::move(compare_left)),
+        right_set(sentinel, std::move(compare_right)) {}
+
+  // Copies put every pair into the slot it has in other and link the trees
+  // balanced, without descents
+  static_bimap(const static_bimap& other)
+      : left_set(sentinel, static_cast<CompareLeft>(other.left_set)),
+        right_set(sentinel, static_cast<CompareRight>(other.right_set)) {
+    copy_pairs(other);
+  }
+
+  static_bimap& operator=(const static_bimap& other) {
+    if (&other != this) {
+      clear();
+      static_cast<CompareLeft&>(left_set) = other.left_set;
+      static_cast<CompareRight&>(right_set) = other.right_set;
+      copy_pairs(other);
+    }
+    return *this;
+  }
+
+  ~static_bimap() noexcept {
+    clear();
+  }
+
+  left_iterator insert(const left_t& left, const right_t& right) {
+    return perfect_forwarding_insert(left, right);
+  }
+
+  left_iterator insert(const left_t& left, right_t&& right) {
+    return perfect_forwarding_insert(left, std::move(right));
+  }
+
+  left_iterator insert(left_t&& left, const right_t& right) {
+    return perfect_forwarding_insert(std::move(left), right);
+  }
+
+  left_iterator insert(left_t&& left, right_t&& right) {
+    return perfect_forwarding_insert(std::move(left), std::move(right));
+  }
+
+  left_iterator erase_left(left_iterator it) noexcept {
+    auto next = std::next(it);
+    erase_node(&static_cast<storage_node&>(*it.it));
+    return next;
+  }
+
+  bool erase_left(const left_t& left) noexcept {
+    return erase_key<left_struct>(left_set, left);
+  }
+
+  right_iterator erase_right(right_iterator it) noexcept {
+    auto next = std::next(it);
+    erase_node(&static_cast<storage_node&>(*it.it));
+    return next;
+  }
+
+  bool erase_right(const right_t& right) noexcept {
+    return erase_key<right_struct>(right_set, right);
+  }
+
+  left_iterator erase_left(left_iterator first, left_iterator last) noexcept {
+    erase_range<left_struct>(left_set, right_set, first.it, last.it);
+    return last;
+  }
+
+  right_iterator erase_right(right_iterator first,
+                             right_iterator last) noexcept {
+    erase_range<right_struct>(right_set, left_set, first.it, last.it);
+    return last;
+  }
+
+  void clear() noexcept {
+    right_set.clear();
+    if constexpr (std::is_trivially_destructible_v<storage_node>) {
+      left_set.clear();
+    } else {
+      // unlinks every node before destroying any, since walking the tree
+      // reads the parents of nodes
+      left_set.erase_if([](const storage_node&) noexcept { return true; },
+                        [](storage_node& node) noexcept {
+                          std::destroy_at(&node);
+                        });
+    }
+    m_size = 0;
+    used = 0;
+    free_list = nullptr;
+  }
+
+  left_iterator find_left(const left_t& left) const noexcept {
+    return left_iterator(left_set.find(left));
+  }
+
+  right_iterator find_right(const right_t& right) const noexcept {
+    return right_iterator(right_set.find(right));
+  }
+
+  right_t const& at_left(const left_t& key) const {
+    return at_key<left_struct>(left_set, key);
+  }
+
+  left_t const& at_right(const right_t& key) const {
+    return at_key<right_struct>(right_set, key);
+  }
+
+  left_iterator lower_bound_left(const left_t& left) const noexcept {
+    return left_iterator(left_set.lower_bound(left));
+  }
+
+  left_iterator upper_bound_left(const left_t& left) const noexcept {
+    return left_iterator(left_set.upper_bound(left));
+  }
+
+  right_iterator lower_bound_right(const right_t& right) const noexcept {
+    return right_iterator(right_set.lower_bound(right));
+  }
+
+  right_iterator upper_bound_right(const right_t& right) const noexcept {
+    return right_iterator(right_set.upper_bound(right));
+  }
+
+  left_iterator begin_left() const noexcept {
+    return left_iterator(left_set.begin());
+  }
+
+  left_iterator end_left() const noexcept {
+    return left_iterator(left_set.end());
+  }
+
+  right_iterator begin_right() const noexcept {
+    return right_iterator(right_set.begin());
+  }
+
+  right_iterator end_right() const noexcept {
+    return right_iterator(right_set.end());
+  }
+
+  bool empty() const noexcept {
+    return m_size == 0;
+  }
+
+  std::size_t size() const noexcept {
+    return m_size;
+  }
+
+  bool full() const noexcept {
+    return m_size == N;
+  }
+
+  static constexpr std::size_t capacity() noexcept {
+    return N;
+  }
+
+  friend bool operator==(const static_bimap& a,
+                         const static_bimap& b) noexcept {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+      auto other = b.find_left(*it);
+      if (other == b.end_left() || other.flip() != b.find_right(*it.flip())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(const static_bimap& a,
+                         const static_bimap& b) noexcept {
+    return !(a == b);
+  }
+
+private:
+  template <typename L, typename R>
+  left_iterator perfect_forwarding_insert(L&& left, R&& right) {
+    if (full()) {
+      return end_left();
+    }
+    auto left_pos = left_set.find_insert_position(left);
+    if (left_pos.exists) {
+      return end_left();
+    }
+    auto right_pos = right_set.find_insert_position(right);
+    if (right_pos.exists) {
+      return end_left();
+    }
+    slot* free = take_slot();
+    storage_node* storage;
+    try {
+      storage = std::construct_at(&free->node, std::forward<L>(left),
+                                  std::forward<R>(right));
+    } catch (...) {
+      give_slot(free);
+      throw;
+    }
+    right_set.insert(*storage, right_pos);
+    m_size++;
+    return left_iterator(left_set.insert(*storage, left_pos));
+  }
+
+  // Slots past used have never held a node, so construction needn't link
+  // them all into the free list
+  slot* take_slot() noexcept {
+    if (free_list) {
+      return std::exchange(free_list, free_list->next_free);
+    }
+    return &slots[used++];
+  }
+
+  void give_slot(slot* free) noexcept {
+    free->next_free = free_list;
+    free_list = free;
+  }
+
+  static slot* slot_of(storage_node* node) noexcept {
+    // a union is pointer-interconvertible with its members
+    return reinterpret_cast<slot*>(node);
+  }
+
+  std::size_t index_of(const storage_node* node) const noexcept {
+    return reinterpret_cast<const slot*>(node) - slots;
+  }
+
+  void erase_node(storage_node* node) noexcept {
+    left_set.erase(typename left_struct::set::iterator(node));
+    right_set.erase(typename right_struct::set::iterator(node));
+    release(*node);
+    m_size--;
+  }
+
+  void release(storage_node& node) noexcept {
+    std::destroy_at(&node);
+    give_slot(slot_of(&node));
+  }
+
+  // Detaches the range from set in O(height), as bimap does, and then
+  // removes its k nodes from the other tree either one by one or, when k
+  // descents would cost more than a walk over the map, in one linear pass
+  template <typename Traits>
+  void erase_range(typename Traits::set& set,
+                   typename Traits::flip_struct::set& other,
+                   typename Traits::set::iterator first,
+                   typename Traits::set::iterator last) noexcept {
+    using other_iterator = typename Traits::flip_struct::set::iterator;
+    using other_base = typename Traits::flip_struct::base_node;
+    if (first == set.begin() && last == set.end()) {
+      clear();
+      return;
+    }
+    std::size_t count = std::distance(first, last);
+    if (count * std::bit_width(m_size) >= m_size) {
+      set.erase(first, last, [](storage_node&) noexcept {});
+      other.erase_if(
+          [](const storage_node& node) noexcept {
+            return !static_cast<const typename Traits::base_node&>(node)
+                        .is_linked();
+          },
+          [this](storage_node& node) noexcept { release(node); });
+    } else {
+      set.erase(first, last, [this, &other](storage_node& node) noexcept {
+        other.erase(other_iterator(static_cast<other_base*>(&node)));
+        release(node);
+      });
+    }
+    m_size -= count;
+  }
+
+  template <typename Traits>
+  bool erase_key(typename Traits::set& set,
+                 const typename Traits::key& key) noexcept {
+    auto it = set.find(key);
+    if (it == set.end()) {
+      return false;
+    }
+    erase_node(&static_cast<storage_node&>(*it));
+    return true;
+  }
+
+  template <typename Traits>
+  static const typename Traits::flip_struct::key&
+  at_key(const typename Traits::set& set, const typename Traits::key& key) {
+    auto it = set.find(key);
+    if (it == set.end()) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return Traits::flip_struct::getter::get(
+        static_cast<const storage_node&>(*it));
+  }
+
+  // Node of this map in the slot where other keeps node
+  template <typename Traits>
+  struct mapped_iterator {
+    const static_bimap* from;
+    static_bimap* to;
+    typename Traits::set::iterator it;
+
+    storage_node* operator*() const noexcept {
+      return &to->slots[from->index_of(&static_cast<storage_node&>(*it))]
+                  .node;
+    }
+
+    mapped_iterator& operator++() noexcept {
+      ++it;
+      return *this;
+    }
+
+    mapped_iterator operator++(int) noexcept {
+      auto tmp = *this;
+      ++it;
+      return tmp;
+    }
+
+    bool operator==(const mapped_iterator& other) const noexcept {
+      return it == other.it;
+    }
+  };
+
+  // Fills this empty map with the pairs of other, each in the same slot
+  void copy_pairs(const static_bimap& other) {
+    using left_mapped = mapped_iterator<left_struct>;
+    using right_mapped = mapped_iterator<right_struct>;
+    for (auto it = other.left_set.begin(); it != other.left_set.end(); ++it) {
+      auto& node = static_cast<const storage_node&>(*it);
+      try {
+        std::construct_at(&slots[other.index_of(&node)].node, node.left_key,
+                          node.right_key);
+      } catch (...) {
+        // the copies aren't linked yet, so find them through other
+        for (auto done = other.left_set.begin(); done != it; ++done) {
+          std::destroy_at(*left_mapped{&other, this, done});
+        }
+        throw;
+      }
+    }
+    left_set.merge_sorted(left_mapped{&other, this, other.left_set.begin()},
+                          left_mapped{&other, this, other.left_set.end()});
+    right_set.merge_sorted(
+        right_mapped{&other, this, other.right_set.begin()},
+        right_mapped{&other, this, other.right_set.end()});
+    m_size = other.m_size;
+    used = other.used;
+    slot** tail = &free_list;
+    for (slot* free = other.free_list; free; free = free->next_free) {
+      *tail = &slots[free - other.slots];
+      tail = &(*tail)->next_free;
+    }
+    *tail = nullptr;
+  }
+
+  bimap_based_node sentinel;
+  std::size_t m_size = 0;
+  // slots below used hold a node or are on the free list
+  std::size_t used = 0;
+  slot* free_list = nullptr;
+  typename left_struct::set left_set;
+  typename right_struct::set right_set;
+  slot slots[N];
+};
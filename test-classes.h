@@ -1,5 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <compare>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
 struct test_object {
   int a = 0;
   test_object() = default;
@@ -15,6 +24,128 @@ struct test_object {
   }
 };
 
+struct test_object_compare {
+  using is_transparent = void;
+
+  bool operator()(test_object const& c, test_object const& b) const {
+    return c.a < b.a;
+  }
+  bool operator()(test_object const& c, int b) const {
+    return c.a < b;
+  }
+  bool operator()(int c, test_object const& b) const {
+    return c < b.a;
+  }
+};
+
+// Equivalent strings may differ in case, so they have different std::hash
+struct case_insensitive_less {
+  bool operator()(const std::string& a, const std::string& b) const {
+    return std::lexicographical_compare(
+        a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+          return std::tolower(static_cast<unsigned char>(x)) <
+                 std::tolower(static_cast<unsigned char>(y));
+        });
+  }
+};
+
+// Counts the comparisons of all its instances under the default std::less
+struct counted_int {
+  int value = 0;
+  static inline size_t comparisons = 0;
+
+  friend bool operator<(counted_int a, counted_int b) {
+    comparisons++;
+    return a.value < b.value;
+  }
+  friend bool operator==(counted_int a, counted_int b) {
+    return a.value == b.value;
+  }
+};
+
+template <>
+struct std::hash<counted_int> {
+  size_t operator()(counted_int key) const noexcept {
+    return std::hash<int>{}(key.value);
+  }
+};
+
+// Copies throw once a countdown shared by all instances runs out, and there
+// are no moves, so containers have to cope with throwing ones
+struct throwing_copy {
+  int value = 0;
+  static inline int countdown = 0;
+
+  explicit throwing_copy(int value_) : value(value_) {}
+  throwing_copy(const throwing_copy& other) : value(other.value) {
+    tick();
+  }
+  throwing_copy& operator=(const throwing_copy& other) {
+    tick();
+    value = other.value;
+    return *this;
+  }
+
+  static void tick() {
+    if (countdown != 0 && --countdown == 0) {
+      throw std::runtime_error("copy failed");
+    }
+  }
+
+  friend bool operator<(const throwing_copy& a, const throwing_copy& b) {
+    return a.value < b.value;
+  }
+  friend bool operator==(const throwing_copy& a, const throwing_copy& b) {
+    return a.value == b.value;
+  }
+};
+
+// Copies throw the same way, but moves never do, as with std::string
+struct nothrow_move_throwing_copy : throwing_copy {
+  using throwing_copy::throwing_copy;
+  nothrow_move_throwing_copy(const nothrow_move_throwing_copy&) = default;
+  nothrow_move_throwing_copy(nothrow_move_throwing_copy&& other) noexcept
+      : throwing_copy(std::exchange(other.value, -1)) {}
+  nothrow_move_throwing_copy&
+  operator=(const nothrow_move_throwing_copy&) = default;
+  nothrow_move_throwing_copy&
+  operator=(nothrow_move_throwing_copy&& other) noexcept {
+    value = std::exchange(other.value, -1);
+    return *this;
+  }
+};
+
+struct counting_three_way {
+  explicit counting_three_way(size_t& counter_) : counter(&counter_) {}
+
+  std::strong_ordering operator()(int a, int b) const {
+    ++*counter;
+    return a <=> b;
+  }
+
+private:
+  size_t* counter;
+};
+
+// Orders ints by their tens first, so that full comparisons, which are
+// counted, only break ties between projections
+struct counting_projection_compare {
+  explicit counting_projection_compare(size_t& counter_)
+      : counter(&counter_) {}
+
+  bool operator()(int a, int b) const {
+    ++*counter;
+    return a < b;
+  }
+
+  int project(int a) const {
+    return a / 10;
+  }
+
+private:
+  size_t* counter;
+};
+
 struct vector_compare {
   using vec = std::pair<int, int>;
   enum distance_type { euclidean, manhattan };
@@ -22,11 +153,12 @@ struct vector_compare {
   explicit vector_compare(distance_type p = euclidean) : type(p) {}
 
   bool operator()(vec a, vec b) const {
-    if (type == euclidean) {
-      return euc(a) < euc(b);
-    } else {
-      return man(a) < man(b);
-    }
+    return project(a) < project(b);
+  }
+
+  // Lets the tree compare cached lengths instead of calling operator()
+  double project(vec a) const {
+    return type == euclidean ? euc(a) : man(a);
   }
 
 private:
@@ -1,7 +1,26 @@
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <set>
+#include <string>
 
 #include "bimap.h"
+#include "coro_lookup.h"
+#include "eytzinger_index.h"
+#include "flat_bimap.h"
+#include "frozen_bimap.h"
+#include "inline_string.h"
+#include "interning_bimap.h"
+#include "learned_index.h"
+#include "perfect_hash_bimap.h"
+#include "prefix_less.h"
+#include "small_bimap.h"
+#include "static_bimap.h"
 #include "test-classes.h"
+#include "unordered_bimap.h"
 #include "gtest/gtest.h"
 
 TEST(bimap, leak_check) {
@@ -171,6 +190,560 @@ TEST(bimap, find) {
   EXPECT_EQ(b.find_right(-1000), b.end_right());
 }
 
+TEST(bimap, transparent_lookup) {
+  bimap<std::string, test_object, std::less<>, test_object_compare> b;
+  b.insert("one", test_object(1));
+  b.insert("three", test_object(3));
+  b.insert("two", test_object(2));
+
+  EXPECT_EQ(b.find_left(std::string_view("two")).flip()->a, 2);
+  EXPECT_EQ(b.find_left("four"), b.end_left());
+  EXPECT_EQ(b.at_left("three").a, 3);
+  EXPECT_EQ(*b.find_right(1).flip(), "one");
+  EXPECT_EQ(b.at_right(2), "two");
+  EXPECT_THROW(b.at_right(5), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_left(std::string_view("p")), "three");
+  EXPECT_EQ(*b.upper_bound_left("three"), "two");
+  EXPECT_EQ(b.lower_bound_right(2)->a, 2);
+  EXPECT_EQ(b.upper_bound_right(2)->a, 3);
+
+  EXPECT_TRUE(b.erase_left(std::string_view("one")));
+  EXPECT_FALSE(b.erase_left("one"));
+  EXPECT_TRUE(b.erase_right(3));
+  EXPECT_EQ(b.size(), 1);
+  b.erase_left(b.begin_left());
+  EXPECT_TRUE(b.empty());
+}
+
+TEST(bimap, projected_keys) {
+  size_t calls = 0;
+  std::mt19937 e(31);
+  bimap<int, int, counting_projection_compare> b(
+      (counting_projection_compare(calls)));
+  std::set<int> lefts;
+  for (int i = 0; i < 2000; i++) {
+    int left = int(e() % 100000);
+    EXPECT_EQ(b.insert(left, i) != b.end_left(), lefts.insert(left).second);
+  }
+  calls = 0;
+  for (int key = 0; key < 100000; key += 7) {
+    EXPECT_EQ(b.find_left(key) != b.end_left(), lefts.count(key) == 1);
+    auto it = b.lower_bound_left(key);
+    auto expected = lefts.lower_bound(key);
+    ASSERT_EQ(it == b.end_left(), expected == lefts.end());
+    if (it != b.end_left()) {
+      EXPECT_EQ(*it, *expected);
+    }
+  }
+  // only keys sharing their tens with a stored key need the comparator, so
+  // most of the lookups never call it
+  EXPECT_LT(calls, 100000 / 7);
+  EXPECT_TRUE(std::equal(b.begin_left(), b.end_left(), lefts.begin(),
+                         lefts.end()));
+}
+
+TEST(bimap, prefix_less) {
+  std::mt19937 e(41);
+  // long shared prefixes, short keys, zero bytes and bytes above 0x7f, which
+  // must order after ASCII as in std::string
+  auto random_key = [&] {
+    static const std::string stems[] = {"", "a", "https://example.com/",
+                                        std::string("ab\0c", 4), "\xff\x01"};
+    std::string key = stems[e() % 5];
+    for (size_t length = e() % 12; length > 0; length--) {
+      key += "ab\0\x80\xff"[e() % 5];
+    }
+    return key;
+  };
+  bimap<std::string, std::string, prefix_less<>, prefix_less<16>> b;
+  std::set<std::string> lefts, rights;
+  for (int i = 0; i < 3000; i++) {
+    auto left = random_key(), right = random_key();
+    bool fresh = !lefts.count(left) && !rights.count(right);
+    EXPECT_EQ(b.insert(left, right) != b.end_left(), fresh);
+    if (fresh) {
+      lefts.insert(left);
+      rights.insert(right);
+    }
+  }
+  EXPECT_TRUE(std::equal(b.begin_left(), b.end_left(), lefts.begin(),
+                         lefts.end()));
+  EXPECT_TRUE(std::equal(b.begin_right(), b.end_right(), rights.begin(),
+                         rights.end()));
+  for (int i = 0; i < 3000; i++) {
+    auto key = random_key();
+    EXPECT_EQ(b.find_left(key) != b.end_left(), lefts.count(key) == 1);
+    EXPECT_EQ(b.find_right(key) != b.end_right(), rights.count(key) == 1);
+    auto it = b.upper_bound_right(key);
+    auto expected = rights.upper_bound(key);
+    ASSERT_EQ(it == b.end_right(), expected == rights.end());
+    if (it != b.end_right()) {
+      EXPECT_EQ(*it, *expected);
+    }
+  }
+}
+
+TEST(bimap, inline_string_keys) {
+  bimap<inline_string, inline_string> b;
+  std::string long_key(100, 'x');
+  // keys are copied into the node, so temporaries and views can go away
+  b.insert(std::string(50, 'a'), long_key);
+  b.insert("b", "");
+  b.insert(std::string_view("c"), std::string(long_key + "y"));
+  long_key.assign(100, 'z');
+  EXPECT_EQ(b.at_left(std::string(50, 'a')), std::string(100, 'x'));
+  EXPECT_EQ(b.at_right(""), "b");
+  EXPECT_NE(b.at_right(std::string(100, 'x')).data(), long_key.data());
+  EXPECT_EQ(b.find_left(long_key), b.end_left());
+  EXPECT_EQ(b.insert("b", "new"), b.end_left());
+  EXPECT_EQ(b.at_left_or_default("d"), "");
+  EXPECT_EQ(b.at_right(""), "d");
+
+  auto copy = b;
+  b.erase_left("c");
+  EXPECT_EQ(copy.size(), 3);
+  EXPECT_EQ(copy.at_left("c"), std::string(100, 'x') + "y");
+  EXPECT_NE(copy, b);
+
+  bimap<inline_string, int, prefix_less<>, std::less<int>,
+        std::hash<inline_string>>
+      hashed;
+  std::mt19937 e(42);
+  std::map<std::string, int> expected;
+  for (int i = 0; i < 2000; i++) {
+    std::string key = std::to_string(e() % 1000) + std::string(e() % 40, '-');
+    EXPECT_EQ(hashed.insert(key, i) != hashed.end_left(),
+              expected.emplace(key, i).second);
+  }
+  hashed.erase_left(hashed.lower_bound_left("3"), hashed.lower_bound_left("6"));
+  std::erase_if(expected,
+                [](auto& p) { return p.first >= "3" && p.first < "6"; });
+  EXPECT_EQ(hashed.size(), expected.size());
+  for (auto& [key, value] : expected) {
+    EXPECT_EQ(hashed.at_left(key), value);
+    EXPECT_EQ(hashed.at_right(value), key);
+  }
+}
+
+TEST(bimap, three_way_comparator) {
+  size_t calls = 0;
+  bimap<std::string, int, std::compare_three_way, counting_three_way> b(
+      std::compare_three_way{}, counting_three_way(calls));
+  b.insert("a", 1);
+  calls = 0;
+  EXPECT_EQ(*b.find_right(1).flip(), "a");
+  EXPECT_EQ(calls, 1);
+
+  b.insert("c", 3);
+  b.insert("b", 2);
+  b.insert("e", 5);
+  EXPECT_EQ(b.at_left("b"), 2);
+  EXPECT_EQ(b.at_right(5), "e");
+  EXPECT_EQ(b.find_right(4), b.end_right());
+  EXPECT_EQ(*b.lower_bound_right(4), 5);
+  EXPECT_EQ(*b.upper_bound_right(3), 5);
+  EXPECT_EQ(*b.lower_bound_left(std::string_view("d")), "e");
+  EXPECT_EQ(*b.upper_bound_left("b"), "c");
+  EXPECT_EQ(b.insert("d", 3), b.end_left());
+  EXPECT_TRUE(b.erase_right(3));
+  EXPECT_EQ(b.find_left("c"), b.end_left());
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+}
+
+TEST(bimap, find_batch) {
+  bimap<int, int> b;
+  std::mt19937 e(7);
+  for (size_t i = 0; i < 5000; i++) {
+    b.insert(e() % 20000, e() % 20000);
+  }
+  std::vector<int> keys(1000);
+  for (auto& key : keys) {
+    key = e() % 20000;
+  }
+
+  std::vector<bimap<int, int>::left_iterator> lefts(keys.size());
+  b.find_left_batch(keys, lefts);
+  std::vector<bimap<int, int>::right_iterator> rights(keys.size());
+  b.find_right_batch(keys, rights);
+  for (size_t i = 0; i < keys.size(); i++) {
+    EXPECT_EQ(lefts[i], b.find_left(keys[i]));
+    EXPECT_EQ(rights[i], b.find_right(keys[i]));
+  }
+
+  std::vector<int> present;
+  for (auto it = b.begin_right(); it != b.end_right(); it++) {
+    present.push_back(*it);
+  }
+  std::shuffle(present.begin(), present.end(), e);
+  std::vector<int> translated(present.size());
+  b.translate_right(present, translated);
+  for (size_t i = 0; i < present.size(); i++) {
+    EXPECT_EQ(translated[i], b.at_right(present[i]));
+  }
+
+  present.push_back(-1);
+  translated.push_back(0);
+  EXPECT_THROW(b.translate_right(present, translated), std::out_of_range);
+  bimap<int, int> empty;
+  empty.find_left_batch(keys, lefts);
+  EXPECT_EQ(lefts.back(), empty.end_left());
+}
+
+TEST(bimap, find_sorted) {
+  std::mt19937 e(11);
+  bimap<int, int, std::greater<>> b;
+  for (size_t i = 0; i < 3000; i++) {
+    b.insert(e() % 10000, e() % 10000);
+  }
+  // sorted keys in a degenerate tree
+  for (int i = 0; i < 300; i++) {
+    b.insert(20000 + i * 2, 20000 + i * 2);
+  }
+  for (size_t probes : {1, 10, 1000, 5000}) {
+    std::vector<int> keys(probes);
+    for (auto& key : keys) {
+      key = e() % 21000;
+    }
+    std::sort(keys.begin(), keys.end(), std::greater<>());
+    std::vector<bimap<int, int, std::greater<>>::left_iterator> lefts(probes);
+    b.find_left_sorted(keys, lefts);
+    std::sort(keys.begin(), keys.end());
+    std::vector<bimap<int, int, std::greater<>>::right_iterator> rights(
+        probes);
+    b.find_right_sorted(keys, rights);
+    for (size_t i = 0; i < probes; i++) {
+      EXPECT_EQ(lefts[i], b.find_left(keys[probes - i - 1]));
+      EXPECT_EQ(rights[i], b.find_right(keys[i]));
+    }
+  }
+}
+
+TEST(bimap, finger_cache) {
+  std::mt19937 e(13);
+  bimap<int, int> b;
+  b.enable_finger_cache();
+  std::map<int, int> lefts;
+  std::map<int, int> rights;
+  int key = 0;
+  for (size_t i = 0; i < 20000; i++) {
+    // mostly short steps in both directions, sometimes a jump
+    key = e() % 16 == 0 ? int(e() % 2000) : key + int(e() % 9) - 3;
+    switch (e() % 6) {
+    case 0:
+      if (!lefts.count(key) && !rights.count(key)) {
+        b.insert(key, key);
+        lefts[key] = key;
+        rights[key] = key;
+      }
+      break;
+    case 1:
+      EXPECT_EQ(b.erase_left(key), lefts.erase(key) == 1);
+      rights.erase(key);
+      break;
+    case 2:
+      if (b.find_right(key) != b.end_right()) {
+        b.erase_right(b.find_right(key));
+        lefts.erase(key);
+        rights.erase(key);
+      }
+      break;
+    default: {
+      auto it = b.lower_bound_left(key);
+      auto expected = lefts.lower_bound(key);
+      ASSERT_EQ(it == b.end_left(), expected == lefts.end());
+      if (it != b.end_left()) {
+        EXPECT_EQ(*it, expected->first);
+      }
+      EXPECT_EQ(b.find_left(key) != b.end_left(), lefts.count(key) == 1);
+      EXPECT_EQ(b.find_right(key) != b.end_right(), rights.count(key) == 1);
+    }
+    }
+  }
+  EXPECT_EQ(b.size(), lefts.size());
+
+  auto copy = b;
+  b.erase_left(b.begin_left(), b.end_left());
+  EXPECT_EQ(b.find_left(key), b.end_left());
+  for (auto [left, right] : lefts) {
+    EXPECT_EQ(copy.at_left(left), right);
+  }
+}
+
+TEST(bimap, lookup_cache) {
+  std::mt19937 e(17);
+  bimap<int, int> b;
+  b.enable_lookup_cache(64);
+  std::map<int, int> lefts;
+  for (int i = 0; i < 500; i++) {
+    b.insert(i, 1000 - i);
+    lefts[i] = 1000 - i;
+  }
+  for (size_t i = 0; i < 20000; i++) {
+    // a few hot keys and a long tail
+    int key = e() % 4 == 0 ? int(e() % 600) : int(e() % 8);
+    switch (e() % 32) {
+    case 0:
+      // the pair is erased and comes back under another node
+      if (b.erase_left(key)) {
+        b.insert(key, 2000 + key);
+        lefts[key] = 2000 + key;
+      }
+      break;
+    case 1:
+      if (lefts.count(key)) {
+        b.erase_right(lefts[key]);
+        b.insert(key, 3000 + key);
+        lefts[key] = 3000 + key;
+      }
+      break;
+    default: {
+      auto it = b.find_left(key);
+      ASSERT_EQ(it != b.end_left(), lefts.count(key) == 1);
+      if (it != b.end_left()) {
+        EXPECT_EQ(*it.flip(), lefts[key]);
+        EXPECT_EQ(b.at_right(lefts[key]), key);
+      }
+    }
+    }
+  }
+  EXPECT_GT(b.left_cache_stats().hits, b.left_cache_stats().misses);
+  EXPECT_GT(b.right_cache_stats().misses, 0);
+
+  b.erase_left(b.begin_left(), b.end_left());
+  for (int key = 0; key < 8; key++) {
+    EXPECT_EQ(b.find_left(key), b.end_left());
+  }
+
+  bimap<test_object, int, test_object_compare> objects;
+  objects.enable_lookup_cache();
+  objects.insert(test_object(1), 1);
+  EXPECT_EQ(objects.at_right(1), test_object(1));
+  EXPECT_EQ(objects.at_right(1), test_object(1));
+  EXPECT_EQ(objects.left_cache_stats().misses, 0);
+  EXPECT_EQ(objects.right_cache_stats().hits, 1);
+
+  // a side whose comparator may disagree with std::hash has no cache, and
+  // lookups through equivalent keys still find their pairs
+  bimap<std::string, int, case_insensitive_less> names;
+  names.enable_lookup_cache();
+  for (int i = 0; i < 100; i++) {
+    std::string name = "a-header-name-that-allocates-" + std::to_string(i);
+    std::string upper = name;
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    names.insert(name, i);
+    EXPECT_EQ(names.at_left(upper), i);
+    EXPECT_EQ(names.at_left(name), i);
+    names.erase_left(name);
+    EXPECT_EQ(names.find_left(upper), names.end_left());
+    EXPECT_EQ(names.find_left(name), names.end_left());
+  }
+  EXPECT_EQ(names.left_cache_stats().hits + names.left_cache_stats().misses,
+            0);
+}
+
+TEST(bimap, bloom_filter) {
+  std::mt19937 e(19);
+  bimap<int, int> b;
+  b.enable_bloom_filter();
+  std::map<int, int> lefts;
+  std::map<int, int> rights;
+  for (size_t i = 0; i < 30000; i++) {
+    int left = int(e() % 5000);
+    int right = int(e() % 5000);
+    switch (e() % 4) {
+    case 0:
+      if (!lefts.count(left) && !rights.count(right)) {
+        b.insert(left, right);
+        lefts[left] = right;
+        rights[right] = left;
+      }
+      break;
+    case 1:
+      if (lefts.count(left)) {
+        rights.erase(lefts[left]);
+        lefts.erase(left);
+      }
+      b.erase_left(left);
+      break;
+    default:
+      EXPECT_EQ(b.find_left(left) != b.end_left(), lefts.count(left) == 1);
+      EXPECT_EQ(b.find_right(right) != b.end_right(), rights.count(right) == 1);
+    }
+  }
+
+  std::vector<std::pair<int, int>> batch;
+  for (int i = 0; i < 2000; i++) {
+    batch.emplace_back(10000 + i, 10000 + i);
+  }
+  b.insert_batch(batch);
+  erase_if(b, [](int left, int) { return left % 3 == 0; });
+  for (int i = 0; i < 12000; i++) {
+    bool present = i < 5000 ? lefts.count(i) == 1 : i >= 10000;
+    present = present && i % 3 != 0;
+    EXPECT_EQ(b.find_left(i) != b.end_left(), present);
+  }
+  b.erase_left(b.begin_left(), b.end_left());
+  EXPECT_EQ(b.find_left(10001), b.end_left());
+  b.insert(10001, 1);
+  EXPECT_EQ(b.at_left(10001), 1);
+
+  // most absent keys are ruled out without a single comparison
+  bimap<int, counted_int> counted;
+  counted.enable_bloom_filter();
+  for (int i = 0; i < 1000; i++) {
+    counted.insert(i, counted_int{i * 2});
+  }
+  size_t skipped = 0;
+  for (int i = 0; i < 1000; i++) {
+    counted_int::comparisons = 0;
+    EXPECT_EQ(counted.find_right(counted_int{i * 2 + 1}), counted.end_right());
+    skipped += counted_int::comparisons == 0;
+  }
+  EXPECT_GT(skipped, 900);
+
+  // equivalent keys may hash apart under other comparators, which get no
+  // filter, so enabling it never changes what lookups find
+  bimap<std::string, int, case_insensitive_less> headers;
+  headers.insert("Content-Type", 1);
+  EXPECT_EQ(headers.at_left("content-type"), 1);
+  headers.enable_bloom_filter();
+  EXPECT_EQ(headers.at_left("content-type"), 1);
+  EXPECT_EQ(headers.at_right(1), "Content-Type");
+  headers.insert("X-Request-Id", 2);
+  EXPECT_EQ(headers.at_left("x-request-id"), 2);
+}
+
+TEST(bimap, accelerators_copy_and_swap) {
+  // maps that enable no accelerator pay one pointer for them
+  static_assert(sizeof(bimap<int, int>) <= 10 * sizeof(void*));
+
+  bimap<int, counted_int> b;
+  b.enable_bloom_filter();
+  b.enable_lookup_cache(64);
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, counted_int{i * 2});
+  }
+  auto copy = b;
+  bimap<int, counted_int> plain;
+  plain.insert(-1, counted_int{-1});
+  plain.swap(b);
+  EXPECT_EQ(b.at_left(-1), counted_int{-1});
+  EXPECT_EQ(b.left_cache_stats().hits + b.left_cache_stats().misses, 0);
+  for (auto* map : {&copy, &plain}) {
+    size_t skipped = 0;
+    for (int i = 0; i < 1000; i++) {
+      counted_int::comparisons = 0;
+      EXPECT_EQ(map->find_right(counted_int{i * 2 + 1}), map->end_right());
+      skipped += counted_int::comparisons == 0;
+      EXPECT_EQ(map->at_left(i), counted_int{i * 2});
+    }
+    EXPECT_GT(skipped, 900);
+    EXPECT_EQ(map->left_cache_stats().misses, 1000);
+  }
+}
+
+TEST(bimap, hash_index) {
+  std::mt19937 e(23);
+  using hashed_bimap = bimap<int, int, std::less<int>, std::greater<int>,
+                             std::hash<int>, std::hash<int>>;
+  hashed_bimap b;
+  std::map<int, int> lefts;
+  std::map<int, int, std::greater<int>> rights;
+  for (size_t i = 0; i < 30000; i++) {
+    int left = int(e() % 3000);
+    int right = int(e() % 3000);
+    switch (e() % 5) {
+    case 0:
+      if (!lefts.count(left) && !rights.count(right)) {
+        b.insert(left, right);
+        lefts[left] = right;
+        rights[right] = left;
+      }
+      break;
+    case 1:
+      EXPECT_EQ(b.erase_right(right), rights.count(right) == 1);
+      if (rights.count(right)) {
+        lefts.erase(rights[right]);
+        rights.erase(right);
+      }
+      break;
+    case 2:
+      if (lefts.count(left)) {
+        EXPECT_EQ(b.at_left(left), lefts[left]);
+        EXPECT_EQ(b.at_right(lefts[left]), left);
+      }
+      break;
+    default: {
+      EXPECT_EQ(b.find_left(left) != b.end_left(), lefts.count(left) == 1);
+      EXPECT_EQ(b.find_right(right) != b.end_right(), rights.count(right) == 1);
+      auto it = b.lower_bound_right(right);
+      auto expected = rights.lower_bound(right);
+      ASSERT_EQ(it == b.end_right(), expected == rights.end());
+      if (it != b.end_right()) {
+        EXPECT_EQ(*it, expected->first);
+        EXPECT_EQ(*it.flip(), expected->second);
+      }
+    }
+    }
+  }
+  EXPECT_EQ(b.size(), lefts.size());
+  EXPECT_TRUE(std::equal(b.begin_right(), b.end_right(), rights.begin(),
+                         rights.end(),
+                         [](int a, auto& pair) { return a == pair.first; }));
+
+  hashed_bimap copy = b;
+  std::vector<std::pair<int, int>> batch;
+  for (int i = 0; i < 1000; i++) {
+    batch.emplace_back(5000 + i, 5000 + i);
+  }
+  b.insert_batch(batch);
+  erase_if(b, [](int left, int) { return left % 2 == 0; });
+  b.erase_left(b.lower_bound_left(5500), b.end_left());
+  for (int i = 0; i < 6000; i++) {
+    bool present = (i < 3000 ? lefts.count(i) == 1 : 5000 <= i && i < 5500) &&
+                   i % 2 != 0;
+    EXPECT_EQ(b.find_left(i) != b.end_left(), present);
+    EXPECT_EQ(copy.find_left(i) != copy.end_left(), lefts.count(i) == 1);
+  }
+  b.swap(copy);
+  EXPECT_EQ(b.size(), lefts.size());
+  for (auto [left, right] : lefts) {
+    EXPECT_EQ(b.at_right(right), left);
+  }
+}
+
+TEST(bimap, async_find) {
+  bimap<int, int> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i * 3, i);
+  }
+  std::vector<int> results(3000, -1);
+  coro::scheduler scheduler(8);
+  for (int key = 0; key < 3000; key++) {
+    scheduler.spawn([](const bimap<int, int>& map, int left,
+                       int& result) -> coro::task<> {
+      auto it = co_await coro::async_find(map.find_left_stepwise(left));
+      if (it != map.end_left()) {
+        auto back =
+            co_await coro::async_find(map.find_right_stepwise(*it.flip()));
+        result = *back.flip();
+      }
+    }(b, key, results[key]));
+  }
+  scheduler.run();
+  for (int key = 0; key < 3000; key++) {
+    EXPECT_EQ(results[key], key % 3 == 0 ? key : -1);
+  }
+
+  scheduler.spawn([]() -> coro::task<> {
+    throw std::runtime_error("lookup failed");
+    co_return;
+  }());
+  EXPECT_THROW(scheduler.run(), std::runtime_error);
+}
+
 TEST(bimap, empty) {
   bimap<int, int> b;
   EXPECT_TRUE(b.empty());
@@ -243,6 +816,74 @@ TEST(bimap, erase_range) {
   EXPECT_TRUE(b.empty());
 }
 
+TEST(bimap, erase_range_matches_maps) {
+  std::mt19937 e(1337);
+  for (size_t round = 0; round < 50; round++) {
+    bimap<int, int> b;
+    std::map<int, int> left_view, right_view;
+    for (size_t i = 0; i < 1000; i++) {
+      int l = e() % 10000, r = e() % 10000;
+      if (b.insert(l, r) != b.end_left()) {
+        left_view[l] = r;
+        right_view[r] = l;
+      }
+    }
+    int from = e() % 10000, to = from + e() % (round * 200 + 1);
+    if (round % 2 == 0) {
+      auto it = b.erase_left(b.lower_bound_left(from), b.lower_bound_left(to));
+      EXPECT_EQ(it, b.lower_bound_left(to));
+      for (auto mit = left_view.lower_bound(from);
+           mit != left_view.lower_bound(to);) {
+        right_view.erase(mit->second);
+        mit = left_view.erase(mit);
+      }
+    } else {
+      b.erase_right(b.lower_bound_right(from), b.lower_bound_right(to));
+      for (auto mit = right_view.lower_bound(from);
+           mit != right_view.lower_bound(to);) {
+        left_view.erase(mit->second);
+        mit = right_view.erase(mit);
+      }
+    }
+    ASSERT_EQ(b.size(), left_view.size());
+    auto lit = b.begin_left();
+    for (auto const& p : left_view) {
+      EXPECT_EQ(*lit, p.first);
+      EXPECT_EQ(*lit.flip(), p.second);
+      lit++;
+    }
+    auto rit = b.begin_right();
+    for (auto const& p : right_view) {
+      EXPECT_EQ(*rit, p.first);
+      EXPECT_EQ(*rit.flip(), p.second);
+      rit++;
+    }
+  }
+}
+
+TEST(bimap, erase_if) {
+  bimap<int, int> b;
+  for (int i = 0; i < 1000; i++) {
+    b.insert(i, (i * 7) % 1000);
+  }
+  EXPECT_EQ(erase_if(b, [](int l, int r) { return (l + r) % 3 == 0; }), 336);
+  EXPECT_EQ(b.size(), 664);
+  for (auto it = b.begin_left(); it != b.end_left(); it++) {
+    EXPECT_NE((*it + *it.flip()) % 3, 0);
+  }
+  int previous = -1;
+  for (auto it = b.begin_right(); it != b.end_right(); it++) {
+    EXPECT_GT(*it, previous);
+    EXPECT_EQ(*it.flip().flip(), *it);
+    previous = *it;
+  }
+
+  EXPECT_EQ(erase_if(b, [](int l, int) { return l == 1; }), 1);
+  EXPECT_EQ(b.find_left(1), b.end_left());
+  EXPECT_EQ(erase_if(b, [](int, int) { return true; }), 663);
+  EXPECT_TRUE(b.empty());
+}
+
 TEST(bimap, lower_bound) {
   bimap<int, int> b;
 
@@ -365,6 +1006,44 @@ TEST(bimap, swap) {
   EXPECT_EQ(*b.find_right(3), 3);
 }
 
+TEST(bimap, insert_batch) {
+  bimap<int, int> b;
+  b.insert(1, 10);
+  b.insert(2, 20);
+
+  std::vector<std::pair<int, int>> batch = {
+      {5, 50}, {1, 11}, {3, 20}, {5, 51}, {6, 50}, {7, 51}, {4, 40}};
+  auto rejected = b.insert_batch(batch);
+
+  std::vector<std::pair<int, int>> correct_rejected = {
+      {1, 11}, {3, 20}, {5, 51}, {6, 50}};
+  EXPECT_EQ(rejected, correct_rejected);
+  EXPECT_EQ(b.size(), 5);
+  EXPECT_EQ(b.at_left(5), 50);
+  EXPECT_EQ(b.at_left(7), 51);
+  EXPECT_EQ(b.at_right(40), 4);
+  EXPECT_EQ(b.at_right(10), 1);
+}
+
+TEST(bimap, insert_batch_matches_insert) {
+  bimap<int, int> batched, sequential;
+  std::mt19937 e(42);
+  for (size_t round = 0; round < 20; round++) {
+    std::vector<std::pair<int, int>> batch(round * round * 10);
+    for (auto& p : batch) {
+      p = {static_cast<int>(e() % 5000), static_cast<int>(e() % 5000)};
+    }
+    std::vector<std::pair<int, int>> rejected;
+    for (auto const& p : batch) {
+      if (sequential.insert(p.first, p.second) == sequential.end_left()) {
+        rejected.push_back(p);
+      }
+    }
+    EXPECT_EQ(batched.insert_batch(batch), rejected);
+    EXPECT_EQ(batched, sequential);
+  }
+}
+
 template <typename T>
 std::vector<std::pair<T, T>>
 eliminate_same(std::vector<T>& lefts, std::vector<T>& rights, std::mt19937& e) {
@@ -464,50 +1143,756 @@ TEST(bimap_randomized, invariant_check) {
             << " erasures. " << skip << " skipped." << std::endl;
 }
 
+// Mirrors b in two std::maps, one per side
+template <typename Bimap>
+struct two_maps {
+  Bimap& b;
+  std::map<int, int> left_view, right_view;
+
+  void insert(int l, int r) {
+    bool full = false;
+    if constexpr (requires { Bimap::capacity(); }) {
+      full = left_view.size() == Bimap::capacity();
+    }
+    if (!left_view.count(l) && !right_view.count(r) && !full) {
+      EXPECT_EQ(*b.insert(l, r).flip(), r);
+      left_view[l] = r;
+      right_view[r] = l;
+    } else {
+      EXPECT_EQ(b.insert(l, r), b.end_left());
+    }
+  }
+
+  void erase_left(int l) {
+    EXPECT_EQ(b.erase_left(l), left_view.count(l) == 1);
+    if (left_view.count(l)) {
+      right_view.erase(left_view[l]);
+      left_view.erase(l);
+    }
+  }
+
+  void erase_found_right(int r) {
+    if (auto it = b.find_right(r); it != b.end_right()) {
+      EXPECT_EQ(*it.flip(), right_view.at(r));
+      b.erase_right(it);
+      left_view.erase(right_view[r]);
+      right_view.erase(r);
+    } else {
+      EXPECT_EQ(right_view.count(r), 0);
+    }
+  }
+
+  // Compares a copy of b with the maps, which also checks copying
+  void check() {
+    Bimap copy = b;
+    ASSERT_EQ(copy, b);
+    ASSERT_EQ(b.size(), left_view.size());
+    std::map<int, int> lefts, rights;
+    for (auto it = copy.begin_left(); it != copy.end_left(); ++it) {
+      lefts[*it] = *it.flip();
+    }
+    for (auto it = copy.begin_right(); it != copy.end_right(); ++it) {
+      rights[*it] = *it.flip();
+    }
+    ASSERT_EQ(lefts, left_view);
+    ASSERT_EQ(rights, right_view);
+    if constexpr (requires { b.lower_bound_left(0); }) {
+      ASSERT_TRUE(std::is_sorted(b.begin_left(), b.end_left()));
+      ASSERT_TRUE(std::is_sorted(b.begin_right(), b.end_right()));
+    }
+  }
+};
+
+// Erases the pairs whose left keys are in [l, l + 5), or whose right keys
+// are in [r, r + 5)
+template <typename Bimap>
+void erase_key_range(two_maps<Bimap>& maps, int l, int r, bool left) {
+  auto& [b, left_view, right_view] = maps;
+  auto& view = left ? left_view : right_view;
+  auto& other = left ? right_view : left_view;
+  int from = left ? l : r;
+  if (left) {
+    b.erase_left(b.lower_bound_left(from), b.lower_bound_left(from + 5));
+  } else {
+    b.erase_right(b.lower_bound_right(from), b.lower_bound_right(from + 5));
+  }
+  for (auto it = view.lower_bound(from);
+       it != view.end() && it->first < from + 5;) {
+    other.erase(it->second);
+    it = view.erase(it);
+  }
+}
+
+// Runs steps random inserts, erases by key and erases by iterator of keys
+// below keys on b, checking it against two std::maps every check_every
+// steps. With extra, a third of the steps call extra(maps, l, r) instead, for
+// the operations only some containers have
+template <typename Bimap, typename Extra = std::nullptr_t>
+void compare_to_two_maps(Bimap& b, std::mt19937& e, size_t steps, int keys,
+                         size_t check_every, Extra extra = nullptr) {
+  two_maps<Bimap> maps{b, {}, {}};
+  constexpr bool has_extra = !std::is_same_v<Extra, std::nullptr_t>;
+  for (size_t i = 0; i < steps; i++) {
+    int l = int(e() % unsigned(keys)), r = int(e() % unsigned(keys));
+    switch (e() % (has_extra ? 6 : 4)) {
+    case 0:
+    case 1:
+      maps.insert(l, r);
+      break;
+    case 2:
+      maps.erase_left(l);
+      break;
+    case 3:
+      maps.erase_found_right(r);
+      break;
+    default:
+      if constexpr (has_extra) {
+        extra(maps, l, r);
+      }
+    }
+    if (i % check_every == 0) {
+      ASSERT_NO_FATAL_FAILURE(maps.check());
+    }
+  }
+  ASSERT_NO_FATAL_FAILURE(maps.check());
+}
+
 TEST(bimap_randomized, compare_to_two_maps) {
   std::cout << "Seed used for randomized cmp2map test is " << seed << std::endl;
-
+  std::mt19937 e(seed);
   bimap<int, int> b;
-  std::map<int, int> left_view, right_view;
+  compare_to_two_maps(b, e, 60000, 5000, 1000);
+}
 
-  std::mt19937 e(seed);
-  size_t ins = 0, skip = 0, total = 60000;
-  for (size_t i = 0; i < total; i++) {
-    unsigned int op = e() % 10;
-    if (op > 2) {
-      ins++;
-      // insertion
-      int l = e(), r = e();
-      b.insert(l, r);
-      left_view.insert({l, r});
-      right_view.insert({r, l});
+TEST(unordered_bimap, simple) {
+  unordered_bimap<std::string, int> b;
+  EXPECT_TRUE(b.empty());
+  EXPECT_NE(b.insert("one", 1), b.end_left());
+  EXPECT_NE(b.insert("two", 2), b.end_left());
+  EXPECT_EQ(b.insert("one", 3), b.end_left());
+  EXPECT_EQ(b.insert("three", 2), b.end_left());
+  EXPECT_EQ(b.size(), 2);
+  EXPECT_EQ(b.at_left("two"), 2);
+  EXPECT_EQ(b.at_right(1), "one");
+  EXPECT_THROW(b.at_left("three"), std::out_of_range);
+  EXPECT_EQ(*b.find_right(2).flip(), "two");
+  EXPECT_EQ(b.find_left("two").flip(), b.find_right(2));
+  EXPECT_EQ(b.end_left().flip(), b.end_right());
+
+  EXPECT_EQ(b.at_right_or_default(0), "");
+  EXPECT_EQ(b.at_left_or_default("two"), 2);
+  EXPECT_EQ(b.at_left_or_default(""), 0);
+  EXPECT_EQ(b.at_right_or_default(5), "");
+  EXPECT_EQ(b.find_right(0), b.end_right());
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  EXPECT_TRUE(b.erase_right(5));
+  EXPECT_FALSE(b.erase_right(5));
+  EXPECT_NE(copy, b);
+  b.erase_left(b.begin_left(), b.end_left());
+  EXPECT_TRUE(b.empty());
+  b.swap(copy);
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(b.at_left("one"), 1);
+}
+
+TEST(unordered_bimap, compare_to_two_maps) {
+  std::mt19937 e(29);
+  unordered_bimap<int, int> b;
+  compare_to_two_maps(b, e, 50000, 5000, 1000);
+}
+
+TEST(interning_bimap, simple) {
+  interning_bimap<std::string> b;
+  EXPECT_EQ(b.intern("a"), 0);
+  EXPECT_EQ(b.intern("c"), 1);
+  EXPECT_EQ(b.intern("b"), 2);
+  EXPECT_EQ(b.intern("a"), 0);
+  EXPECT_EQ(b.at_right(1), "c");
+  EXPECT_EQ(b.at_left("b"), 2);
+  EXPECT_THROW(b.at_right(3), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_left("bb"), "c");
+  EXPECT_EQ(b.find_right(2).id(), 2);
+
+  EXPECT_TRUE(b.erase_right(1));
+  EXPECT_FALSE(b.erase_left("c"));
+  EXPECT_THROW(b.at_right(1), std::out_of_range);
+  EXPECT_EQ(b.find_right(1), b.end_left());
+  // freed ids are reused before new ones are assigned
+  EXPECT_EQ(b.intern("d"), 1);
+  EXPECT_EQ(b.intern("e"), 3);
+  EXPECT_EQ(b.id_bound(), 4);
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  copy.erase_left("a");
+  EXPECT_NE(copy, b);
+  EXPECT_EQ(copy.intern("f"), 0);
+  EXPECT_EQ(b.size(), 4);
+  std::vector<std::string> keys(b.begin_left(), b.end_left());
+  EXPECT_EQ(keys, (std::vector<std::string>{"a", "b", "d", "e"}));
+}
+
+TEST(interning_bimap, compare_to_maps) {
+  std::mt19937 e(43);
+  interning_bimap<int> b;
+  std::map<int, uint32_t> ids;
+  std::set<uint32_t> free;
+  uint32_t bound = 0;
+  for (size_t i = 0; i < 50000; i++) {
+    int key = int(e() % 3000);
+    if (e() % 3) {
+      uint32_t id = b.intern(key);
+      if (ids.count(key)) {
+        EXPECT_EQ(id, ids[key]);
+      } else {
+        EXPECT_TRUE(free.erase(id) || id == bound++);
+        ids[key] = id;
+      }
     } else {
-      // erasure
-      if (b.empty()) {
-        skip++;
-        continue;
+      EXPECT_EQ(b.erase_left(key), ids.count(key) == 1);
+      if (ids.count(key)) {
+        free.insert(ids[key]);
+        ids.erase(key);
       }
-      auto it = b.end_left();
-      while (it == b.end_left()) {
-        it = b.lower_bound_left(e());
+    }
+    if (i % 1000 == 0) {
+      EXPECT_EQ(b.size(), ids.size());
+      EXPECT_EQ(b.id_bound(), bound);
+      for (auto& [key, id] : ids) {
+        EXPECT_EQ(b.at_right(id), key);
+      }
+      for (uint32_t id : free) {
+        EXPECT_EQ(b.find_right(id), b.end_left());
       }
-      EXPECT_EQ(left_view.erase(*it), 1);
-      EXPECT_EQ(right_view.erase(*it.flip()), 1);
-      b.erase_left(it);
     }
-    if (i % 100 == 0) {
-      // check
-      EXPECT_EQ(b.size(), left_view.size());
-      EXPECT_EQ(b.size(), right_view.size());
-      auto lit = b.begin_left();
-      auto mlit = left_view.begin();
-      for (; lit != b.end_left() && mlit != left_view.end(); lit++, mlit++) {
-        EXPECT_EQ(*lit, mlit->first);
-        EXPECT_EQ(*lit.flip(), mlit->second);
+  }
+}
+
+TEST(small_bimap, simple) {
+  small_bimap<int, std::string, 4> b;
+  b.insert(3, "c");
+  b.insert(1, "z");
+  b.insert(2, "a");
+  EXPECT_TRUE(b.is_inline());
+  EXPECT_EQ(b.insert(1, "b"), b.end_left());
+  EXPECT_EQ(b.insert(4, "a"), b.end_left());
+  EXPECT_EQ(b.at_left(1), "z");
+  EXPECT_EQ(b.at_right("a"), 2);
+  EXPECT_THROW(b.at_left(5), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_right("b"), "c");
+  EXPECT_EQ(*b.upper_bound_left(2), 3);
+  EXPECT_EQ(*b.find_right("c").flip(), 3);
+  EXPECT_EQ(b.find_left(2).flip().flip(), b.find_left(2));
+  EXPECT_EQ(b.end_left().flip(), b.end_right());
+  std::vector<std::string> rights(b.begin_right(), b.end_right());
+  EXPECT_EQ(rights, (std::vector<std::string>{"a", "c", "z"}));
+
+  auto copy = b;
+  b.insert(0, "x");
+  b.insert(5, "y");
+  EXPECT_FALSE(b.is_inline());
+  EXPECT_EQ(b.size(), 5);
+  EXPECT_EQ(b.at_right("y"), 5);
+  EXPECT_TRUE(copy.is_inline());
+  EXPECT_NE(copy, b);
+  EXPECT_TRUE(b.erase_left(0));
+  EXPECT_TRUE(b.erase_right("y"));
+  EXPECT_EQ(copy, b);
+
+  copy.swap(b);
+  EXPECT_TRUE(b.is_inline());
+  EXPECT_FALSE(copy.is_inline());
+  b.clear();
+  EXPECT_TRUE(b.empty());
+  copy.clear();
+  EXPECT_TRUE(copy.is_inline());
+}
+
+TEST(small_bimap, throwing_moves) {
+  // every copy of the insert may throw; the map either holds the new pair
+  // or stays as it was
+  for (int countdown = 1; countdown < 40; countdown++) {
+    small_bimap<throwing_copy, int, 8> b;
+    for (int i : {1, 3, 5, 7}) {
+      b.insert(throwing_copy(i), i);
+    }
+    throwing_copy key(4);
+    throwing_copy::countdown = countdown;
+    bool inserted = true;
+    try {
+      b.insert(key, 4);
+    } catch (const std::runtime_error&) {
+      inserted = false;
+    }
+    throwing_copy::countdown = 0;
+    std::vector<int> expected{1, 3, 5, 7};
+    if (inserted) {
+      expected.insert(expected.begin() + 2, 4);
+    }
+    std::vector<int> lefts, rights(b.begin_right(), b.end_right());
+    for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+      lefts.push_back(it->value);
+    }
+    EXPECT_EQ(lefts, expected);
+    EXPECT_EQ(rights, expected);
+    EXPECT_EQ(b.size(), expected.size());
+  }
+}
+
+TEST(small_bimap, throwing_copy) {
+  // the slots copied before a copy throws are freed, which the leak
+  // checker of sanitized builds sees through the heap-allocated strings
+  small_bimap<throwing_copy, std::string, 8> b;
+  for (int i = 0; i < 6; i++) {
+    b.insert(throwing_copy(i), std::string(64, char('a' + i)));
+  }
+  for (int countdown = 1; countdown < 6; countdown++) {
+    throwing_copy::countdown = countdown;
+    EXPECT_THROW(auto copy = b, std::runtime_error);
+  }
+  throwing_copy::countdown = 0;
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+}
+
+TEST(small_bimap, layout) {
+  // the tree is allocated only on overflow
+  static_assert(sizeof(small_bimap<int, int, 16>) <=
+                16 * (2 * sizeof(int) + 2) + 2 * sizeof(void*));
+
+  // flipping reads the rank of the slot instead of counting keys
+  small_bimap<int, counted_int, 16> b;
+  for (int i = 0; i < 16; i++) {
+    b.insert(i, counted_int{(i * 7) % 16});
+  }
+  counted_int::comparisons = 0;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    EXPECT_EQ(it.flip()->value, (*it * 7) % 16);
+    EXPECT_EQ(it.flip().flip(), it);
+  }
+  EXPECT_EQ(counted_int::comparisons, 0);
+}
+
+TEST(small_bimap, compare_to_two_maps) {
+  std::mt19937 e(44);
+  for (int round = 0; round < 50; round++) {
+    small_bimap<int, int, 8> b;
+    compare_to_two_maps(b, e, 200, 20, 1);
+  }
+}
+
+TEST(flat_bimap, simple) {
+  flat_bimap<int, std::string> b;
+  b.insert(3, "c");
+  b.insert(1, "z");
+  b.insert(2, "a");
+  EXPECT_EQ(b.insert(1, "b"), b.end_left());
+  EXPECT_EQ(b.insert(4, "a"), b.end_left());
+  EXPECT_EQ(b.at_left(1), "z");
+  EXPECT_EQ(b.at_right("a"), 2);
+  EXPECT_THROW(b.at_left(5), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_right("b"), "c");
+  EXPECT_EQ(*b.upper_bound_left(2), 3);
+  EXPECT_EQ(*b.find_right("c").flip(), 3);
+  EXPECT_EQ(b.find_left(2).flip().flip(), b.find_left(2));
+  EXPECT_EQ(b.end_left().flip(), b.end_right());
+  std::vector<std::string> rights(b.begin_right(), b.end_right());
+  EXPECT_EQ(rights, (std::vector<std::string>{"a", "c", "z"}));
+
+  // rejected as taken by the map, by an earlier pair, and as a duplicate
+  std::vector<std::pair<int, std::string>> batch{
+      {0, "y"}, {4, "c"}, {5, "x"}, {6, "x"}, {5, "w"}, {0, "y"}};
+  auto rejected = b.insert_batch(batch);
+  EXPECT_EQ(rejected.size(), 4);
+  EXPECT_EQ(b.size(), 5);
+  EXPECT_EQ(b.at_right("x"), 5);
+  EXPECT_EQ(*b.begin_left().flip(), "y");
+
+  flat_bimap<int, std::string> sorted(sorted_unique, b.begin_left(),
+                                      b.end_left());
+  EXPECT_EQ(sorted, b);
+  EXPECT_EQ(*sorted.begin_right(), "a");
+  EXPECT_EQ(sorted.at_right("y"), 0);
+
+  std::map<int, std::string> more{{7, "v"}, {8, "a"}, {9, "u"}};
+  rejected = sorted.insert(more.begin(), more.end());
+  EXPECT_EQ(rejected, (std::vector<std::pair<int, std::string>>{{8, "a"}}));
+  EXPECT_EQ(sorted.size(), 7);
+  EXPECT_EQ(sorted.at_left(9), "u");
+
+  // erases move-assign the pairs after them, so they may throw if that can
+  static_assert(noexcept(b.erase_left(0)));
+  static_assert(
+      !noexcept(std::declval<flat_bimap<int, throwing_copy>&>().erase_left(0)));
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  EXPECT_TRUE(b.erase_left(0));
+  EXPECT_NE(copy, b);
+  b.erase_right(b.find_right("a"), b.end_right());
+  EXPECT_EQ(b.size(), 0);
+  copy.swap(b);
+  EXPECT_EQ(b.size(), 5);
+  b.clear();
+  EXPECT_TRUE(b.empty());
+}
+
+TEST(flat_bimap, throwing_batch_copy) {
+  using key = nothrow_move_throwing_copy;
+  std::vector<std::pair<key, int>> pairs, batch;
+  for (int i : {1, 3, 5, 7}) {
+    pairs.emplace_back(key(i), i);
+  }
+  for (int i : {2, 6, 8}) {
+    batch.emplace_back(key(i), i);
+  }
+  // a copy of the batch may throw after the map's keys would have moved
+  for (int countdown = 1; countdown < 20; countdown++) {
+    flat_bimap<key, int> b;
+    b.insert_batch(pairs);
+    throwing_copy::countdown = countdown;
+    bool inserted = true;
+    try {
+      b.insert_batch(batch);
+    } catch (const std::runtime_error&) {
+      inserted = false;
+    }
+    throwing_copy::countdown = 0;
+    std::vector<int> expected{1, 3, 5, 7};
+    if (inserted) {
+      expected = {1, 2, 3, 5, 6, 7, 8};
+    }
+    std::vector<int> lefts, rights(b.begin_right(), b.end_right());
+    for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+      lefts.push_back(it->value);
+    }
+    EXPECT_EQ(lefts, expected);
+    EXPECT_EQ(rights, expected);
+  }
+}
+
+TEST(flat_bimap, compare_to_two_maps) {
+  std::mt19937 e(46);
+  flat_bimap<int, int> b;
+  compare_to_two_maps(b, e, 5000, 100, 1, [&](auto& maps, int l, int r) {
+    auto& [flat, left_view, right_view] = maps;
+    if (e() % 2) {
+      std::vector<std::pair<int, int>> batch;
+      for (int j = 0; j < 8; j++) {
+        batch.emplace_back(int(e() % 100), int(e() % 100));
+      }
+      std::vector<std::pair<int, int>> expected;
+      for (auto [bl, br] : batch) {
+        if (left_view.count(bl) || right_view.count(br)) {
+          expected.emplace_back(bl, br);
+        } else {
+          left_view[bl] = br;
+          right_view[br] = bl;
+        }
       }
+      EXPECT_EQ(flat.insert_batch(batch), expected);
+      return;
     }
+    erase_key_range(maps, l, r, e() % 2);
+  });
+}
+
+TEST(frozen_bimap, freeze) {
+  bimap<int, std::string> b;
+  b.insert(2, "a");
+  b.insert(1, "c");
+  b.insert(3, "b");
+  auto frozen = b.freeze();
+  b.erase_left(1);
+  b.insert(4, "d");
+  EXPECT_EQ(frozen.size(), 3);
+  EXPECT_EQ(frozen.at_left(1), "c");
+  EXPECT_EQ(frozen.at_right("b"), 3);
+  EXPECT_THROW(frozen.at_left(4), std::out_of_range);
+  EXPECT_EQ(*frozen.find_right("a").flip(), 2);
+  EXPECT_EQ(*frozen.lower_bound_left(0), 1);
+  EXPECT_EQ(frozen.upper_bound_right("c"), frozen.end_right());
+  std::vector<std::string> rights(frozen.begin_right(), frozen.end_right());
+  EXPECT_EQ(rights, (std::vector<std::string>{"a", "b", "c"}));
+  EXPECT_NE(b.freeze(), frozen);
+  EXPECT_TRUE((frozen_bimap<int, int>().empty()));
+}
+
+TEST(frozen_bimap, inline_string_keys) {
+  // the frozen maps copy the characters the keys of the source point into,
+  // so they outlive it, and so do their copies
+  std::vector<std::string> names;
+  for (int i = 0; i < 100; i++) {
+    names.push_back("header-name-" + std::to_string(i * 7));
   }
-  std::cout << "Comparing to maps stat:" << std::endl;
-  std::cout << "Performed " << ins << " insertions and " << total - ins - skip
-            << " erasures. " << skip << " skipped." << std::endl;
+  std::optional<frozen_bimap<inline_string, inline_string>> frozen;
+  std::optional<perfect_hash_bimap<inline_string, int>> hashed;
+  {
+    bimap<inline_string, inline_string> b;
+    bimap<inline_string, int> tags;
+    for (int i = 0; i < 100; i++) {
+      b.insert(names[i], "value-" + std::to_string(i));
+      tags.insert(names[i], i);
+    }
+    frozen.emplace(b.freeze());
+    hashed.emplace(tags.begin_left(), tags.end_left());
+  }
+  auto copy = *frozen;
+  frozen.reset();
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(copy.at_left(names[i]), "value-" + std::to_string(i));
+    EXPECT_EQ(copy.at_right("value-" + std::to_string(i)), names[i]);
+    EXPECT_EQ(hashed->at_right(i), names[i]);
+    EXPECT_EQ(hashed->at_left(names[i]), i);
+  }
+  EXPECT_TRUE(std::is_sorted(copy.begin_left(), copy.end_left()));
+}
+
+// Checks an index over the sorted distinct keys against std::lower_bound
+// and std::upper_bound at every key, past every key and at random keys
+template <template <typename> class Index, typename Key>
+void check_sorted_index(const std::vector<Key>& keys, std::mt19937& e) {
+  Index<Key> index(keys.begin(), keys.end());
+  auto check = [&](Key key) {
+    auto lower = std::lower_bound(keys.begin(), keys.end(), key);
+    auto upper = std::upper_bound(keys.begin(), keys.end(), key);
+    ASSERT_EQ(index.lower_bound(key), lower - keys.begin());
+    ASSERT_EQ(index.upper_bound(key), upper - keys.begin());
+    ASSERT_EQ(index.find(key),
+              lower != keys.end() && *lower == key ? lower - keys.begin()
+                                                   : keys.size());
+  };
+  for (Key key : keys) {
+    check(key);
+    if (key != std::numeric_limits<Key>::max()) {
+      check(static_cast<Key>(key + 1));
+    }
+  }
+  for (int i = 0; i < 1000; i++) {
+    check(static_cast<Key>(uint64_t(e()) << 32 | e()));
+  }
+}
+
+// Freezes a map large enough to get an Index on each side
+template <template <typename> class Index>
+void check_indexed_freeze() {
+  constexpr int size = 1 << 18;
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = 0; i < size; i++) {
+    pairs.emplace_back(i * 3, -i);
+  }
+  bimap<int, int> b;
+  b.insert_batch(pairs);
+  auto frozen = b.freeze<Index>();
+  EXPECT_EQ(frozen.at_left(300), -100);
+  EXPECT_EQ(frozen.at_right(-100), 300);
+  EXPECT_EQ(frozen.find_left(301), frozen.end_left());
+  EXPECT_EQ(*frozen.lower_bound_left(301), 303);
+  EXPECT_EQ(*frozen.upper_bound_right(-1), 0);
+  EXPECT_EQ(*frozen.lower_bound_right(-size), 1 - size);
+  EXPECT_EQ(frozen.upper_bound_left(3 * (size - 1)), frozen.end_left());
+}
+
+template <typename Key>
+std::vector<Key> random_sorted_keys(std::size_t size, std::mt19937& e) {
+  std::set<Key> distinct{std::numeric_limits<Key>::min(),
+                         std::numeric_limits<Key>::max()};
+  while (distinct.size() < size) {
+    distinct.insert(static_cast<Key>(e()));
+  }
+  return {distinct.begin(), distinct.end()};
+}
+
+TEST(frozen_bimap, eytzinger_index) {
+  std::mt19937 e(48);
+  for (std::size_t size : {2, 3, 17, 100, 1000, 5000}) {
+    check_sorted_index<eytzinger_index>(random_sorted_keys<int32_t>(size, e),
+                                        e);
+    check_sorted_index<eytzinger_index>(random_sorted_keys<uint32_t>(size, e),
+                                        e);
+    check_sorted_index<eytzinger_index>(random_sorted_keys<int64_t>(size, e),
+                                        e);
+    check_sorted_index<eytzinger_index>(random_sorted_keys<uint64_t>(size, e),
+                                        e);
+    check_sorted_index<eytzinger_index>(
+        random_sorted_keys<uint16_t>(std::min<std::size_t>(size, 300), e), e);
+  }
+  EXPECT_EQ(eytzinger_index<int>().lower_bound(5), 0);
+
+  // every kernel this CPU can run agrees with the scalar one
+  alignas(64) int32_t block[16];
+  alignas(64) uint64_t wide[8];
+  for (int i = 0; i < 1000; i++) {
+    std::generate(block, block + 16, [&] { return int32_t(e() % 64) - 32; });
+    std::generate(wide, wide + 8, [&] { return uint64_t(e()) << (e() % 33); });
+    int32_t key = int32_t(e() % 64) - 32;
+    auto expected = simd::count_less_scalar(block, key);
+    EXPECT_EQ(simd::pick_count_less<int32_t>()(block, key), expected);
+#ifdef BIMAP_X86_KERNELS
+    EXPECT_EQ(simd::count_less_sse2(block, key), expected);
+#endif
+    uint64_t wide_key = uint64_t(e()) << (e() % 33);
+    EXPECT_EQ(simd::pick_count_less<uint64_t>()(wide, wide_key),
+              simd::count_less_scalar(wide, wide_key));
+  }
+
+  check_indexed_freeze<eytzinger_index>();
+}
+
+TEST(frozen_bimap, learned_index) {
+  std::mt19937 e(49);
+  for (std::size_t size : {1, 2, 100, 10000}) {
+    // sequential ids, timestamps with jitter and gaps, and random keys
+    std::vector<uint64_t> ids, times;
+    std::set<int64_t> random{std::numeric_limits<int64_t>::min(),
+                             std::numeric_limits<int64_t>::max()};
+    for (std::size_t i = 0; i < size; i++) {
+      ids.push_back(i + 7);
+      times.push_back(1'700'000'000'000 + i * 1000 + e() % 900 +
+                      (i > size / 2 ? 50'000'000 : 0));
+      random.insert(int64_t(uint64_t(e()) << 32 | e()));
+    }
+    check_sorted_index<learned_index>(ids, e);
+    check_sorted_index<learned_index>(times, e);
+    check_sorted_index<learned_index>(
+        std::vector<int64_t>(random.begin(), random.end()), e);
+  }
+  EXPECT_EQ(learned_index<int>().find(5), 0);
+
+  // smooth keys need a handful of segments
+  std::vector<uint64_t> ids(1'000'000);
+  std::iota(ids.begin(), ids.end(), 0);
+  EXPECT_LT(learned_index<uint64_t>(ids.begin(), ids.end()).model_bytes(),
+            1024);
+
+  check_indexed_freeze<learned_index>();
+}
+
+TEST(perfect_hash_bimap, simple) {
+  std::vector<std::pair<std::string, int>> fields{
+      {"version", 8}, {"sender", 49}, {"target", 56}, {"sequence", 34}};
+  perfect_hash_bimap<std::string, int> b(fields);
+  EXPECT_EQ(b.size(), 4);
+  EXPECT_EQ(b.at_left("sender"), 49);
+  EXPECT_EQ(b.at_right(34), "sequence");
+  EXPECT_THROW(b.at_left("checksum"), std::out_of_range);
+  EXPECT_EQ(b.find_right(10), b.end_right());
+  EXPECT_EQ(*b.find_left("target").flip(), 56);
+  EXPECT_EQ(b.find_right(8).flip(), b.find_left("version"));
+  std::map<std::string, int> walked;
+  for (auto it = b.begin_left(); it != b.end_left(); ++it) {
+    walked[*it] = *it.flip();
+  }
+  EXPECT_EQ(walked, (std::map<std::string, int>(fields.begin(), fields.end())));
+
+  bimap<std::string, int> tree;
+  for (auto& [name, tag] : fields) {
+    tree.insert(name, tag);
+  }
+  perfect_hash_bimap<std::string, int> copy(tree.begin_left(),
+                                            tree.end_left());
+  EXPECT_EQ(copy, b);
+  copy.swap(b);
+  EXPECT_EQ(b.at_right(56), "target");
+  perfect_hash_bimap<int, int> empty;
+  EXPECT_EQ(empty.find_left(1), empty.end_left());
+
+  fields.emplace_back("sender", 9);
+  EXPECT_THROW((perfect_hash_bimap<std::string, int>(fields)),
+               std::invalid_argument);
+}
+
+TEST(perfect_hash_bimap, bounded_pilot_search) {
+  std::mt19937_64 e(50);
+  std::vector<uint64_t> hashes(1000);
+  for (auto& hash : hashes) {
+    hash = e();
+  }
+  // a single pilot can't place all buckets under any seed
+  EXPECT_THROW(minimal_perfect_hash(hashes, 1, 4), std::runtime_error);
+
+  // 3000 pilots fail under the first seed but not under a later one
+  EXPECT_THROW(minimal_perfect_hash(hashes, 3000, 1), std::runtime_error);
+  minimal_perfect_hash function(hashes, 3000);
+  std::vector<bool> hit(hashes.size());
+  for (auto hash : hashes) {
+    size_t slot = function(hash);
+    ASSERT_LT(slot, hashes.size());
+    EXPECT_FALSE(hit[slot]);
+    hit[slot] = true;
+  }
+}
+
+TEST(perfect_hash_bimap, compare_to_map) {
+  std::mt19937 e(50);
+  for (std::size_t size : {1, 2, 5, 100, 10000, 200000}) {
+    std::map<uint64_t, uint32_t> pairs_map;
+    std::set<uint32_t> used;
+    while (pairs_map.size() < size) {
+      uint64_t left = uint64_t(e()) << 32 | e();
+      uint32_t right = uint32_t(e());
+      if (!pairs_map.count(left) && used.insert(right).second) {
+        pairs_map[left] = right;
+      }
+    }
+    std::vector<std::pair<uint64_t, uint32_t>> pairs(pairs_map.begin(),
+                                                     pairs_map.end());
+    perfect_hash_bimap<uint64_t, uint32_t> b(pairs);
+    ASSERT_EQ(b.size(), size);
+    for (auto [left, right] : pairs) {
+      ASSERT_EQ(b.at_left(left), right);
+      ASSERT_EQ(b.at_right(right), left);
+    }
+    for (int i = 0; i < 1000; i++) {
+      uint64_t left = uint64_t(e()) << 32 | e();
+      uint32_t right = uint32_t(e());
+      EXPECT_EQ(b.find_left(left) != b.end_left(), pairs_map.count(left) == 1);
+      EXPECT_EQ(b.find_right(right) != b.end_right(), used.count(right) == 1);
+    }
+  }
+}
+
+TEST(static_bimap, simple) {
+  static_bimap<int, std::string, 3> b;
+  EXPECT_EQ(b.capacity(), 3);
+  b.insert(2, "b");
+  b.insert(1, "c");
+  EXPECT_EQ(b.insert(1, "d"), b.end_left());
+  auto it = b.insert(3, "a");
+  EXPECT_TRUE(b.full());
+  // full: rejected like a taken key, and nothing changes
+  EXPECT_EQ(b.insert(4, "e"), b.end_left());
+  EXPECT_EQ(b.size(), 3);
+  EXPECT_EQ(*it.flip(), "a");
+  EXPECT_EQ(b.at_right("c"), 1);
+  EXPECT_THROW(b.at_left(4), std::out_of_range);
+  EXPECT_EQ(*b.lower_bound_right("bb"), "c");
+  EXPECT_EQ(b.end_left().flip(), b.end_right());
+
+  EXPECT_TRUE(b.erase_left(2));
+  EXPECT_FALSE(b.full());
+  EXPECT_NE(b.insert(4, "e"), b.end_left());
+  // iterators of other pairs survive inserts and erases
+  EXPECT_EQ(*it, 3);
+
+  auto copy = b;
+  EXPECT_EQ(copy, b);
+  copy.erase_right("e");
+  EXPECT_NE(copy, b);
+  EXPECT_NE(copy.insert(5, "f"), copy.end_left());
+  EXPECT_EQ(copy.insert(6, "g"), copy.end_left());
+  b = copy;
+  EXPECT_EQ(b.at_left(5), "f");
+  b.clear();
+  EXPECT_TRUE(b.empty());
+}
+
+TEST(static_bimap, compare_to_two_maps) {
+  std::mt19937 e(45);
+  static_bimap<int, int, 64> b;
+  compare_to_two_maps(b, e, 50000, 100, 100, [&](auto& maps, int l, int r) {
+    erase_key_range(maps, l, r, e() % 2);
+  });
 }
@@ -0,0 +1,394 @@
+#pragma once
+
+#include "intrusive_hash_set.h"
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Bimap without ordering: each pair is one node linked into a hash index per
+// side, so lookups on both sides are O(1) expected and flip() is O(1).
+// Iterators walk a side in table order. Like those of std::unordered_map they
+// are invalidated by inserts that rehash and by swap
+template <typename Left, typename Right, typename HashLeft = std::hash<Left>,
+          typename HashRight = std::hash<Right>,
+          typename EqualLeft = std::equal_to<Left>,
+          typename EqualRight = std::equal_to<Right>>
+struct unordered_bimap {
+private:
+  using left_t = Left;
+  using right_t = Right;
+  struct tag_for_left;
+  struct tag_for_right;
+
+  template <typename T>
+  struct template_iterator;
+
+  struct storage_node;
+
+  struct right_struct;
+
+  struct left_struct {
+  public:
+    struct getter {
+      static const left_t& get(const storage_node& storage_node) noexcept {
+        return storage_node.left_key;
+      }
+    };
+    using key = left_t;
+    using equal = EqualLeft;
+    using base_node = intrusive::hash_node<tag_for_left>;
+    using set = intrusive::intrusive_hash_set<storage_node, key, tag_for_left,
+                                              HashLeft, getter>;
+    using iterator = template_iterator<left_struct>;
+    using flip_struct = right_struct;
+  };
+
+  struct right_struct {
+  public:
+    struct getter {
+      static const right_t& get(const storage_node& storage_node) noexcept {
+        return storage_node.right_key;
+      }
+    };
+    using key = right_t;
+    using equal = EqualRight;
+    using base_node = intrusive::hash_node<tag_for_right>;
+    using set = intrusive::intrusive_hash_set<storage_node, key, tag_for_right,
+                                              HashRight, getter>;
+    using iterator = template_iterator<right_struct>;
+    using flip_struct = left_struct;
+  };
+
+  struct storage_node : left_struct::base_node, right_struct::base_node {
+  public:
+    typename left_struct::key left_key;
+    typename right_struct::key right_key;
+
+    template <typename L, typename R>
+    storage_node(L&& l, R&& r)
+        : left_key(std::forward<L>(l)), right_key(std::forward<R>(r)) {}
+  };
+
+  template <class Traits>
+  struct template_iterator {
+  private:
+    friend struct unordered_bimap;
+
+    template <typename U>
+    friend struct template_iterator;
+
+    const unordered_bimap* map = nullptr;
+    storage_node* node = nullptr;
+
+    template_iterator(const unordered_bimap* map_, storage_node* node_) noexcept
+        : map(map_), node(node_) {}
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using getter = typename Traits::getter;
+    using value_type = typename Traits::key;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    template_iterator() = default;
+
+    reference operator*() const noexcept {
+      return getter::get(*node);
+    }
+
+    pointer operator->() const noexcept {
+      return &operator*();
+    }
+
+    template_iterator& operator++() noexcept {
+      node = map->template set_of<Traits>().next(*node);
+      return *this;
+    }
+
+    template_iterator operator++(int) noexcept {
+      auto tmp = *this;
+      operator++();
+      return tmp;
+    }
+
+    typename Traits::flip_struct::iterator flip() const noexcept {
+      return typename Traits::flip_struct::iterator(map, node);
+    }
+
+    friend bool operator==(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.node == right.node;
+    }
+
+    friend bool operator!=(const template_iterator& left,
+                           const template_iterator& right) noexcept {
+      return left.node != right.node;
+    }
+  };
+
+public:
+  using left_iterator = typename left_struct::iterator;
+
+  using right_iterator = typename right_struct::iterator;
+
+  unordered_bimap(HashLeft hash_left = HashLeft(),
+                  HashRight hash_right = HashRight(),
+                  EqualLeft equal_left = EqualLeft(),
+                  EqualRight equal_right = EqualRight())
+      : left_set(std::move(hash_left)), right_set(std::move(hash_right)),
+        left_equal(std::move(equal_left)),
+        right_equal(std::move(equal_right)) {}
+
+  unordered_bimap(const unordered_bimap& other)
+      : left_set(static_cast<HashLeft>(other.left_set)),
+        right_set(static_cast<HashRight>(other.right_set)),
+        left_equal(other.left_equal), right_equal(other.right_equal) {
+    reserve(other.size());
+    for (auto it = other.begin_left(); it != other.end_left(); ++it) {
+      insert(*it, *it.flip());
+    }
+  }
+
+  unordered_bimap& operator=(const unordered_bimap& other) {
+    if (&other != this) {
+      unordered_bimap(other).swap(*this);
+    }
+    return *this;
+  }
+
+  ~unordered_bimap() noexcept {
+    clear();
+  }
+
+  void swap(unordered_bimap& other) noexcept {
+    left_set.swap(other.left_set);
+    right_set.swap(other.right_set);
+    std::swap(left_equal, other.left_equal);
+    std::swap(right_equal, other.right_equal);
+  }
+
+  // Makes room for size pairs, so that inserts up to that size neither
+  // allocate buckets nor invalidate iterators
+  void reserve(std::size_t size) {
+    left_set.reserve(size);
+    right_set.reserve(size);
+  }
+
+  left_iterator insert(const left_t& left, const right_t& right) {
+    return perfect_forwarding_insert(left, right);
+  }
+
+  left_iterator insert(const left_t& left, right_t&& right) {
+    return perfect_forwarding_insert(left, std::move(right));
+  }
+
+  left_iterator insert(left_t&& left, const right_t& right) {
+    return perfect_forwarding_insert(std::move(left), right);
+  }
+
+  left_iterator insert(left_t&& left, right_t&& right) {
+    return perfect_forwarding_insert(std::move(left), std::move(right));
+  }
+
+  left_iterator erase_left(left_iterator it) noexcept {
+    auto next = std::next(it);
+    erase_node(it.node);
+    return next;
+  }
+
+  bool erase_left(const left_t& left) noexcept {
+    return erase_key<left_struct>(left);
+  }
+
+  right_iterator erase_right(right_iterator it) noexcept {
+    auto next = std::next(it);
+    erase_node(it.node);
+    return next;
+  }
+
+  bool erase_right(const right_t& right) noexcept {
+    return erase_key<right_struct>(right);
+  }
+
+  // Erasing in table order never skips pairs, so [first, last) goes exactly
+  // as far as iterating from first to last would
+  left_iterator erase_left(left_iterator first, left_iterator last) noexcept {
+    while (first != last) {
+      first = erase_left(first);
+    }
+    return last;
+  }
+
+  right_iterator erase_right(right_iterator first,
+                             right_iterator last) noexcept {
+    while (first != last) {
+      first = erase_right(first);
+    }
+    return last;
+  }
+
+  void clear() noexcept {
+    for (auto* node = left_set.first(); node;) {
+      delete std::exchange(node, left_set.next(*node));
+    }
+    left_set.clear();
+    right_set.clear();
+  }
+
+  left_iterator find_left(const left_t& left) const noexcept {
+    return left_iterator(this, find<left_struct>(left));
+  }
+
+  right_iterator find_right(const right_t& right) const noexcept {
+    return right_iterator(this, find<right_struct>(right));
+  }
+
+  right_t const& at_left(const left_t& key) const {
+    return at_key<left_struct>(key);
+  }
+
+  left_t const& at_right(const right_t& key) const {
+    return at_key<right_struct>(key);
+  }
+
+  // Same as bimap: inserts the key with a default constructed opposite key,
+  // taking that key over from the pair that held it
+  template <typename Q = right_t,
+            typename = std::enable_if_t<std::is_default_constructible_v<Q>>>
+  right_t const& at_left_or_default(const left_t& key) {
+    if (auto it = find_left(key); it != end_left()) {
+      return *it.flip();
+    }
+    right_t tmp{};
+    if (auto it = find_right(tmp); it != end_right()) {
+      erase_right(it);
+    }
+    return *insert(key, std::move(tmp)).flip();
+  }
+
+  template <typename Q = left_t,
+            typename = std::enable_if_t<std::is_default_constructible_v<Q>>>
+  left_t const& at_right_or_default(const right_t& key) {
+    if (auto it = find_right(key); it != end_right()) {
+      return *it.flip();
+    }
+    left_t tmp{};
+    if (auto it = find_left(tmp); it != end_left()) {
+      erase_left(it);
+    }
+    return *insert(std::move(tmp), key);
+  }
+
+  left_iterator begin_left() const noexcept {
+    return left_iterator(this, left_set.first());
+  }
+
+  left_iterator end_left() const noexcept {
+    return left_iterator(this, nullptr);
+  }
+
+  right_iterator begin_right() const noexcept {
+    return right_iterator(this, right_set.first());
+  }
+
+  right_iterator end_right() const noexcept {
+    return right_iterator(this, nullptr);
+  }
+
+  bool empty() const noexcept {
+    return size() == 0;
+  }
+
+  std::size_t size() const noexcept {
+    return left_set.size();
+  }
+
+  // Equal when both hold the same pairs, whatever their table order
+  friend bool operator==(unordered_bimap const& a,
+                         unordered_bimap const& b) noexcept {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (auto it = a.begin_left(); it != a.end_left(); ++it) {
+      auto other = b.find_left(*it);
+      if (other == b.end_left() || !a.right_equal(*it.flip(), *other.flip())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  friend bool operator!=(unordered_bimap const& a,
+                         unordered_bimap const& b) noexcept {
+    return !(a == b);
+  }
+
+private:
+  template <typename Traits>
+  const typename Traits::set& set_of() const noexcept {
+    if constexpr (std::is_same_v<Traits, left_struct>) {
+      return left_set;
+    } else {
+      return right_set;
+    }
+  }
+
+  template <typename Traits>
+  storage_node* find(const typename Traits::key& key) const noexcept {
+    const auto& equal = [this]() -> const typename Traits::equal& {
+      if constexpr (std::is_same_v<Traits, left_struct>) {
+        return left_equal;
+      } else {
+        return right_equal;
+      }
+    }();
+    return set_of<Traits>().find(key, equal);
+  }
+
+  template <typename Traits>
+  bool erase_key(const typename Traits::key& key) noexcept {
+    if (auto* node = find<Traits>(key)) {
+      erase_node(node);
+      return true;
+    }
+    return false;
+  }
+
+  template <typename Traits>
+  const typename Traits::flip_struct::key&
+  at_key(const typename Traits::key& key) const {
+    auto* node = find<Traits>(key);
+    if (!node) {
+      throw std::out_of_range("element doesn't exist");
+    }
+    return Traits::flip_struct::getter::get(*node);
+  }
+
+  template <typename L, typename R>
+  left_iterator perfect_forwarding_insert(L&& left, R&& right) {
+    if (find<left_struct>(left) || find<right_struct>(right)) {
+      return end_left();
+    }
+    reserve(size() + 1);
+    auto* storage =
+        new storage_node(std::forward<L>(left), std::forward<R>(right));
+    left_set.insert(*storage);
+    right_set.insert(*storage);
+    return left_iterator(this, storage);
+  }
+
+  void erase_node(storage_node* node) noexcept {
+    left_set.erase(*node);
+    right_set.erase(*node);
+    delete node;
+  }
+
+  typename left_struct::set left_set;
+  typename right_struct::set right_set;
+  [[no_unique_address]] EqualLeft left_equal;
+  [[no_unique_address]] EqualRight right_equal;
+};